@@ -0,0 +1,225 @@
+
+
+/*
+ * MDPC (Morse Decompositions for Piecewise Constant vector fields)
+ * Copyright (c) 2012  Andrzej Szymczak
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included 
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+ * ANDRZEJ SZYMCZAK BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF 
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ *
+*/
+
+#include <binfile.h>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+/* ------------------------------------------------------ */
+
+size_t binfile::_align ( size_t n )
+{
+  return (n+7)&~(size_t)7;
+}
+
+// sets the block offsets for header h and returns the file size
+
+size_t binfile::_blocks ( const binheader &h, size_t *ooff, size_t *ioff, 
+			  size_t *coff, size_t *voff )
+{
+  *ooff = _align(sizeof(binheader));
+  *ioff = *ooff + (h.degree ? 0 : _align(((size_t)h.faces+1)*sizeof(int)));
+  *coff = *ioff + _align((size_t)h.indices*sizeof(int));
+  *voff = *coff + _align((size_t)3*h.vertices*h.realsize);
+  return *voff + (size_t)3*h.vectors*h.realsize;
+}
+
+/* ------------------------------------------------------ */
+
+binfile::binfile ( const char *name ) : fd(-1), base(NULL), size(0)
+{
+  struct stat st;
+  fd = open(name,O_RDONLY);
+  if (fd<0 || fstat(fd,&st))
+    {
+      cout << "Can't open " << name << endl;
+      exit(1);
+    }
+  size = st.st_size;
+  if (size<sizeof(binheader))
+    {
+      cout << "Premature end of file: " << name << endl;
+      exit(1);
+    }
+  void *m = mmap(NULL,size,PROT_READ,MAP_PRIVATE,fd,0);
+  if (m==MAP_FAILED)
+    {
+      cout << "Can't map " << name << endl;
+      exit(1);
+    }
+  base = (const char*)m;
+  memcpy(&h,base,sizeof(binheader));
+
+  if (memcmp(h.magic,"MDPC",4) || h.version!=1 || 
+      (h.realsize!=4 && h.realsize!=8) || h.faces<0 || h.vertices<0 ||
+      h.degree<0 || h.indices<0 || h.vectors<0 || 
+      (h.degree && (size_t)h.indices!=(size_t)h.degree*h.faces))
+    {
+      cout << "Not a valid binary input file: " << name << endl;
+      exit(1);
+    }
+  if (_blocks(h,&ooff,&ioff,&coff,&voff)>size)
+    {
+      cout << "Premature end of file: " << name << endl;
+      exit(1);
+    }
+  if (!h.degree)
+    {
+      // offsets have to go from 0 to indices without decreasing, so that 
+      // index() stays inside the index block
+      bool ok = first(0)==0 && first(h.faces)==h.indices;
+      for ( int i=0; ok && i<h.faces; i++ )
+	ok = first(i)<=first(i+1);
+      if (!ok)
+	{
+	  cout << "Not a valid binary input file: " << name << endl;
+	  exit(1);
+	}
+    }
+
+  // the blocks are read front to back, once
+  madvise(m,size,MADV_SEQUENTIAL);
+}
+
+/* ------------------------------------------------------ */
+
+binfile::~binfile()
+{
+  if (base)
+    munmap((void*)base,size);
+  if (fd>=0)
+    close(fd);
+}
+
+/* ------------------------------------------------------ */
+
+bool binfile::isbinary ( const char *name )
+{
+  char m[4];
+  ifstream ifs(name,ios::binary);
+  return ifs.read(m,4) && !memcmp(m,"MDPC",4);
+}
+
+/* ------------------------------------------------------ */
+
+bool binfile::write ( const char *name, int degree, int faces, const int *offsets, 
+		      const int *indices, int indexcnt, int vertices, const double *coords, 
+		      int vectors, const double *vecs, int realsize )
+{
+  binheader h;
+  memcpy(h.magic,"MDPC",4);
+  h.version = 1;
+  h.faces = faces;
+  h.vertices = vertices;
+  h.degree = degree;
+  h.realsize = realsize;
+  h.indices = indexcnt;
+  h.vectors = vectors;
+
+  size_t oo,io,co,vo;
+  size_t total = _blocks(h,&oo,&io,&co,&vo);
+
+  ofstream ofs(name,ios::binary);
+  if (!ofs)
+    return false;
+
+  // each block, then zeros up to the start of the next one
+  const char zero[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  ofs.write((const char*)&h,sizeof(binheader));
+  ofs.write(zero,oo-sizeof(binheader));
+  if (!degree)
+    {
+      ofs.write((const char*)offsets,((size_t)faces+1)*sizeof(int));
+      ofs.write(zero,io-oo-((size_t)faces+1)*sizeof(int));
+    }
+  ofs.write((const char*)indices,(size_t)indexcnt*sizeof(int));
+  ofs.write(zero,co-io-(size_t)indexcnt*sizeof(int));
+  for ( int b=0; b<2; b++ )
+    {
+      const double *x = b ? vecs : coords;
+      size_t n = (size_t)3*(b ? vectors : vertices);
+      if (realsize==8)
+	ofs.write((const char*)x,n*sizeof(double));
+      else
+	for ( size_t k=0; k<n; k++ )
+	  {
+	    float y = x[k];
+	    ofs.write((const char*)&y,sizeof(float));
+	  }
+      if (!b)
+	ofs.write(zero,vo-co-n*realsize);
+    }
+
+  return ofs && (size_t)ofs.tellp()==total;
+}
+
+/* ------------------------------------------------------ */
+
+int binfile::first ( int i )
+{
+  if (h.degree)
+    return h.degree*i;
+  return ((const int*)(base+ooff))[i];
+}
+
+int binfile::index ( int k )
+{
+  return ((const int*)(base+ioff))[k];
+}
+
+/* ------------------------------------------------------ */
+
+vec3dd binfile::coordinate ( int i )
+{
+  if (h.realsize==8)
+    {
+      const double *p = (const double*)(base+coff)+3*(size_t)i;
+      return vec3dd(p[0],p[1],p[2]);
+    }
+  const float *p = (const float*)(base+coff)+3*(size_t)i;
+  return vec3dd(p[0],p[1],p[2]);
+}
+
+vec3dd binfile::vector ( int i )
+{
+  if (h.realsize==8)
+    {
+      const double *p = (const double*)(base+voff)+3*(size_t)i;
+      return vec3dd(p[0],p[1],p[2]);
+    }
+  const float *p = (const float*)(base+voff)+3*(size_t)i;
+  return vec3dd(p[0],p[1],p[2]);
+}
+
+/* ------------------------------------------------------ */
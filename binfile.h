@@ -0,0 +1,99 @@
+
+
+/*
+ * MDPC (Morse Decompositions for Piecewise Constant vector fields)
+ * Copyright (c) 2012  Andrzej Szymczak
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included 
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+ * ANDRZEJ SZYMCZAK BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF 
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ *
+*/
+
+#ifndef __BINFILE_H
+#define __BINFILE_H
+
+#include <global.h>
+#include <cstddef>
+#include <vec3d.h>
+
+/* ------------------------------------------------------ */
+
+// header of the binary input format (see README.txt); the blocks follow 
+// it in this order, each starting at a multiple of 8 bytes: face offsets 
+// (faces+1 int32, only if degree is 0), face vertex indices (indices 
+// int32), vertex coordinates (3*vertices reals), vectors (3*vectors reals).
+// Everything is in native byte order
+
+class binheader {
+ public:
+  char magic[4];   // "MDPC"
+  int version;     // 1
+  int faces;
+  int vertices;
+  int degree;      // vertices of every face (3 for .t files), or 0 if they differ
+  int realsize;    // 4 (float32) or 8 (float64) for coordinates and vectors
+  int indices;     // total number of face vertex indices
+  int vectors;     // per face or per vertex, as for the ASCII formats
+};
+
+/* ------------------------------------------------------ */
+
+// an input file in the binary format, mapped into memory
+
+class binfile {
+
+  int fd;
+  const char *base;
+  size_t size;
+
+  // block offsets, in bytes
+  size_t ooff, ioff, coff, voff;
+
+  static size_t _align ( size_t n );
+  static size_t _blocks ( const binheader &h, size_t *ooff, size_t *ioff, 
+			  size_t *coff, size_t *voff );
+
+ public:
+
+  binheader h;
+
+  // maps file name; exits if it is not a valid binary input file
+  binfile ( const char *name );
+  ~binfile();
+
+  // does file name start with the magic number of the binary format?
+  static bool isbinary ( const char *name );
+
+  // writes a binary input file; offsets is ignored for degree!=0. 
+  // False if name can't be written
+  static bool write ( const char *name, int degree, int faces, const int *offsets, 
+		      const int *indices, int indexcnt, int vertices, const double *coords, 
+		      int vectors, const double *vecs, int realsize );
+
+  // the vertex indices of face i start at index(first(i)); it has 
+  // first(i+1)-first(i) of them
+  int first ( int i );
+  int index ( int k );
+
+  vec3dd coordinate ( int i );   // vertex i
+  vec3dd vector ( int i );       // vector i
+};
+
+/* ------------------------------------------------------ */
+
+#endif
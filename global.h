@@ -24,3 +24,9 @@
 */
 
 #define NDEBUG
+
+// store vertex coordinates, normals, the vectors of the field and the 
+// per-face data derived from them (projections, hull vectors) as floats;
+// computations on them are still done in double (see vec3dg in vec3d.h).
+// Uncomment, or add -DMDPC_FLOAT to OPT in the Makefile
+// #define MDPC_FLOAT
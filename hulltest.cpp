@@ -0,0 +1,122 @@
+
+/*
+ * MDPC (Morse Decompositions for Piecewise Constant vector fields)
+ * Copyright (c) 2012  Andrzej Szymczak
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included 
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+ * ANDRZEJ SZYMCZAK BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF 
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ *
+*/
+
+// checks of the hull predicates of pchull.cpp on hand-built vector sets;
+// built and run by 'make hullcheck'
+
+#include <pchull.cpp>
+#include <iostream>
+
+using namespace std;
+
+/* ------------------------------------------------------ */
+
+static int failed = 0;
+static int checks = 0;
+
+static void check ( bool ok, const char *what )
+{
+  checks++;
+  if (!ok)
+    {
+      cout << "FAILED: " << what << endl;
+      failed++;
+    }
+}
+
+/* ------------------------------------------------------ */
+
+// all vectors in the plane z=0, seen from the tip of n=(0,0,1)
+static void test_sweep()
+{
+  vec3dd n(0,0,1);
+  int r,l;
+
+  vec3dg a[3] = { vec3dg(1,0,0), vec3dg(0,1,0), vec3dg(1,1,0) };
+  check(!_sweep(n,a,3,&r,&l),"_sweep: quarter plane");
+  check(r==0 && l==1,"_sweep: extreme vectors of a quarter plane");
+
+  vec3dg b[3] = { vec3dg(1,0,0), vec3dg(-1,1,0), vec3dg(-1,-1,0) };
+  check(_sweep(n,b,3,&r,&l),"_sweep: vectors around zero");
+
+  vec3dg c[3] = { vec3dg(1,0,0), vec3dg(0,1,0), vec3dg(-1,0,0) };
+  check(_sweep(n,c,3,&r,&l),"_sweep: opposite vectors");
+
+  vec3dg d[2] = { vec3dg(1,0,0), vec3dg(2,0,0) };
+  check(!_sweep(n,d,2,&r,&l),"_sweep: parallel vectors");
+
+  vec3dg e[2] = { vec3dg(1,0,0), vec3dg(0,0,0) };
+  check(_sweep(n,e,2,&r,&l),"_sweep: zero vector");
+
+  check(!_zeroinhull(n,c,2),"_zeroinhull: fewer than three vectors");
+  check(_zeroinhull(n,b,3),"_zeroinhull: vectors around zero");
+}
+
+/* ------------------------------------------------------ */
+
+// edge along tv=(1,0,0) in the plane orthogonal to p=(0,0,1); the 
+// components along p are projected away
+static void test_testdir()
+{
+  vec3dd tv(1,0,0), p(0,0,1);
+
+  vec3dg pos1[1] = { vec3dg(1,0,0) };
+  vec3dg pos2[1] = { vec3dg(2,0,3) };
+  vec3dg neg1[1] = { vec3dg(-1,0,0) };
+  vec3dg neg2[1] = { vec3dg(-3,0,0) };
+  check(_testdir(tv,p,pos1,1,pos2,1)==1,"_testdir: both on the line, ahead");
+  check(_testdir(tv,p,neg1,1,neg2,1)==2,"_testdir: both on the line, behind");
+  check(_testdir(tv,p,neg1,1,pos1,1)==3,"_testdir: both on the line, across");
+
+  vec3dg up1[1] = { vec3dg(1,1,0) };
+  vec3dg dn1[1] = { vec3dg(1,-1,0) };
+  vec3dg up2[1] = { vec3dg(-1,1,0) };
+  vec3dg dn2[1] = { vec3dg(-1,-1,0) };
+  vec3dg up3[1] = { vec3dg(2,1,0) };
+  check(_testdir(tv,p,up1,1,dn1,1)==1,"_testdir: crossing ahead");
+  check(_testdir(tv,p,up2,1,dn2,1)==2,"_testdir: crossing behind");
+  check(_testdir(tv,p,up1,1,up3,1)==0,"_testdir: same side");
+  check(_testdir(tv,p,pos1,1,up2,1)==1,"_testdir: one on the line, ahead");
+  check(_testdir(tv,p,up1,1,neg1,1)==2,"_testdir: one on the line, behind");
+
+  vec3dg mix[2] = { vec3dg(1,1,0), vec3dg(-1,1,0) };
+  check(_testdir(tv,p,mix,2,dn1,1)==3,"_testdir: crossings on both sides");
+}
+
+/* ------------------------------------------------------ */
+
+int main ( )
+{
+  test_sweep();
+  test_testdir();
+
+  if (failed)
+    {
+      cout << failed << " of " << checks << " checks failed" << endl;
+      return 1;
+    }
+  cout << "hulltest: " << checks << " checks passed" << endl;
+  return 0;
+}
@@ -0,0 +1,138 @@
+
+
+/*
+ * MDPC (Morse Decompositions for Piecewise Constant vector fields)
+ * Copyright (c) 2012  Andrzej Szymczak
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included 
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+ * ANDRZEJ SZYMCZAK BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF 
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ *
+*/
+
+#include <binfile.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+
+/* ------------------------------------------------------ */
+
+void print_usage()
+{
+  cout << "Usage: " << endl;
+  cout << " mdbconv [-f] <IN> <OUT>" << endl;
+  cout << "   IN : input file in one of the ASCII formats (.t, or starting with 'n')" << endl;
+  cout << "   OUT: the same mesh and vectors in the binary format, which mdpc and msvis" << endl;
+  cout << "        read much faster" << endl;
+  cout << "  options: " << endl;
+  cout << "   -f : store coordinates and vectors as float32 (default: float64)" << endl;
+}
+
+/* ------------------------------------------------------ */
+
+int main ( int argc, char *argv[] )
+{
+  int i = 1;
+  int realsize = 8;
+
+  if (argc>i && !strcmp(argv[i],"-f"))
+    {
+      realsize = 4;
+      i++;
+    }
+  if (argc!=i+2)
+    {
+      print_usage();
+      return 0;
+    }
+
+  ifstream ifs(argv[i]);
+  if (!ifs)
+    {
+      cout << "Can't open " << argv[i] << endl;
+      return 1;
+    }
+
+  // detect format, as mesh does
+  char c = ifs.get();
+  char format = 'n';
+  if (c!='n')
+    {
+      ifs.putback(c);
+      format = 't';
+    }
+
+  int fs,vs,j;
+  ifs >> fs >> vs;
+  if (!ifs || fs<0 || vs<0)
+    {
+      cout << "Premature end of file: " << argv[i] << endl;
+      return 1;
+    }
+
+  // faces: offsets into the index list, as in the binary format
+  vector<int> off(1,0), idx;
+  for ( j=0; j<fs; j++ )
+    {
+      int a;
+      if (format=='t')
+	for ( int k=0; k<3; k++ )
+	  {
+	    ifs >> a;
+	    idx.push_back(a);
+	  }
+      else
+	while (ifs >> a && a!=-1)
+	  idx.push_back(a);
+      off.push_back(idx.size());
+    }
+
+  vector<double> crd(3*(size_t)vs);
+  for ( j=0; j<3*vs; j++ )
+    ifs >> crd[j];
+  if (!ifs)
+    {
+      cout << "Premature end of file: " << argv[i] << endl;
+      return 1;
+    }
+
+  // the vectors are what remains: per face or per vertex
+  vector<double> vec;
+  double x;
+  while (ifs >> x)
+    vec.push_back(x);
+  if (vec.size()%3)
+    cout << "Warning: " << vec.size()%3 << " trailing numbers ignored" << endl;
+
+  if (!binfile::write(argv[i+1],format=='t' ? 3 : 0,fs,&off[0],idx.data(),idx.size(),
+		      vs,crd.data(),vec.size()/3,vec.data(),realsize))
+    {
+      cout << "Can't write " << argv[i+1] << endl;
+      return 1;
+    }
+
+  cout << fs << " faces, " << vs << " vertices, " << vec.size()/3 << " vectors written to " 
+       << argv[i+1] << endl;
+
+  return 0;
+}
+
+/* ------------------------------------------------------ */
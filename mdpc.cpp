@@ -26,6 +26,15 @@
 #include <pcstable.h>
 #include <pcenv.h>
 #include <tgraph.h>
+#include <primitive.h>
+#include <parallel.h>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <unistd.h>
 
 using namespace std;
 
@@ -54,7 +63,6 @@ const char *it[7] =
     "Other: "
   };
 
-int ic[7] = { 0, 0, 0, 0, 0, 0, 0 };
 
 /* ------------------------------------------------------ */
 
@@ -83,26 +91,28 @@ const char *bt[8] =
       "Other: "
     };
 
-int bc[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
 
 /* ------------------------------------------------------ */
 
-void print_statistics ()
+// ic and bc: counts of the interior and boundary types above, one pair 
+// of arrays per decomposition
+
+void print_statistics ( ostream &o, const int *ic, const int *bc )
 {
-  cout << "---------- MORSE SET COUNTS -----------" << endl;
+  o << "---------- MORSE SET COUNTS -----------" << endl;
   for ( int i=0; i<7; i++ )
-    cout << " " << it[i] << ic[i] << endl;
+    o << " " << it[i] << ic[i] << endl;
   if (bc[0]+bc[1]+bc[2]+bc[3]+bc[4]+bc[5]+bc[6]+bc[7])
     {
-      cout << "Morse sets touching the boundary: " << endl;
+      o << "Morse sets touching the boundary: " << endl;
       for ( int i=0; i<8; i++ )
-	cout << "   " << bt[i] << bc[i] << endl;
+	o << "   " << bt[i] << bc[i] << endl;
     }
 }
 
 /* ------------------------------------------------------ */
 
-void new_MS ( mstype t )
+void new_MS ( mstype t, int *ic, int *bc )
 {
   int j;
 
@@ -145,12 +155,42 @@ void print_usage()
   cout << "   OUT-DOT: dot file containing the MCG (graphviz can be used to draw the MCG)" << endl;
   cout << "  options: " << endl;
   cout << "   -c <MIN> <MAX>: compute MCG; MIN and MAX are refinement thresholds " << endl;
+  cout << "                   (can be repeated; then OUT-SEP and OUT-DOT get a _MIN_MAX suffix, and" << endl;
+  cout << "                   the pairs are done in increasing order on the same graph: each starts from" << endl;
+  cout << "                   the refinement of the previous ones, so its MCG can be finer than the one" << endl;
+  cout << "                   of a run with that pair alone)" << endl;
   cout << "   -s <R>        : compute stable Morse decomposition with radius R" << endl;
   cout << "   -h <WEIGHT>   : compute hull-based stable Morse decomposition" << endl;
   cout << "   -v            : vertex based input" << endl;
   cout << "   -e <WEIGHT>   : envelope (only with -v)" << endl;
+  cout << "                   R and WEIGHT can be comma-separated lists: the input is then read and" << endl;
+  cout << "                   preprocessed once and a decomposition computed for each value; output" << endl;
+  cout << "                   file names get a _VALUE suffix. With --mem-budget, decompositions for" << endl;
+  cout << "                   several values run at the same time as far as physical memory allows" << endl;
   cout << "   -t            : include trivial Morse sets in the MCG" << endl;
   cout << "   -o            : treat the vector field as open system (allow flow into/out of domain)" << endl;
+  cout << "   -q <A> <B> <L>: only check if Morse set A connects to Morse set B, refining the" << endl;
+  cout << "                   connection region to level L; OUT-SEP gets the region; can't be used with -c" << endl;
+  cout << "   -j <N>        : use N threads (default: number of hardware threads)" << endl;
+  cout << "   --save-checkpoint <FILE> : save the transition graph to FILE after each refinement iteration" << endl;
+  cout << "   --resume <FILE>          : start from a checkpoint saved for the same input and options" << endl;
+  cout << "   --scc-tree <FILE>        : save the SCC hierarchy across refinement iterations to FILE" << endl;
+  cout << "   --radius-tree <FILE>     : with a list of radii for -s, refine only for the largest one and" << endl;
+  cout << "                              save the nested Morse sets for all radii to FILE (largest first)" << endl;
+  cout << "   --mem-budget <MB>        : limit the size of the transition graph during refinement;" << endl;
+  cout << "                              only the most important Morse sets are refined when it gets tight" << endl;
+  cout << "   --frames <FILE>          : time series: after IN, compute a Morse decomposition for each frame" << endl;
+  cout << "                              of vectors in FILE (as in IN, per face or with -v per vertex), reusing" << endl;
+  cout << "                              the mesh and the data of unchanged faces; output file names get a" << endl;
+  cout << "                              _f<K> suffix, K=0 for IN" << endl;
+  cout << "   --frame-tol <T>          : vectors that change by at most T between frames are kept (default 0)" << endl;
+  cout << "   --validate <REF>         : compare the Morse sets in OUT-MD with the ones in REF, saved by a run" << endl;
+  cout << "                              with the same options (e.g. by a build without MDPC_FLOAT), and report" << endl;
+  cout << "                              the ones that differ; REF gets the same suffixes as OUT-MD" << endl;
+  cout << "   --batch <FILE>           : after IN, compute Morse decompositions for more fields on its mesh, one" << endl;
+  cout << "                              per file listed (a line each) in FILE, with only the vectors (as in IN);" << endl;
+  cout << "                              the mesh is shared by all of them, and with --mem-budget several fields" << endl;
+  cout << "                              are done at the same time; output file names get a _b<K> suffix, K=0 for IN" << endl;
 }
 
 /* ------------------------------------------------------ */
@@ -163,8 +203,536 @@ static char type = 'f';
 static bool inct = false;
 static bool osys = false;
 
-static double R,wt;
-static int minr, maxr;
+// values given to -s, or to -h or -e, and their text (for output names)
+static vector<double> R,wt;
+static vector<string> Rtext,wttext;
+static vector<pair<int,int> > thr;  // (MIN,MAX) refinement thresholds for MCGs
+static bool qopt = false;
+static int qa, qb, qlevel;         // connection query: Morse sets and refinement level
+
+static const char *ckpt = NULL;    // checkpoint to write
+static const char *resume = NULL;  // checkpoint to start from
+static const char *scctree = NULL; // SCC hierarchy output
+static const char *rtree = NULL;   // hierarchy of Morse sets across the -s radii
+static double budget = 0;          // memory budget for refinement, bytes; 0 if none
+static const char *frames = NULL;  // time series: vectors of the frames after the input's
+static double ftol = 0;            // change of a vector between frames that is ignored
+static const char *batch = NULL;   // list of files with the vectors of more fields on IN's mesh
+static const char *validate = NULL; // Morse sets to compare OUT-MD with
+
+/* ------------------------------------------------------ */
+
+// name with sfx inserted before the extension
+
+static string suffixed ( const string &name, const string &sfx )
+{
+  string res = name;
+  size_t dot = res.find_last_of('.');
+  size_t slash = res.find_last_of('/');
+  if (dot==string::npos || (slash!=string::npos && dot<slash))
+    return res + sfx;
+  return res.insert(dot,sfx);
+}
+
+// name of an output for one field: tag (_f<K> for frame K of a time 
+// series, _b<K> for field K of a batch, empty otherwise) inserted before 
+// the extension
+
+static string tagged ( const string &name, const string &tag )
+{
+  if (tag.empty())
+    return name;
+  return suffixed(name,tag);
+}
+
+// name of an output for the v-th -s/-h/-e value: as above if there is 
+// only one, otherwise with _VALUE inserted first
+
+static string outname ( const char *name, const string &tag, int v )
+{
+  const vector<string> &txt = sopt ? Rtext : wttext;
+  if (txt.size()<=1)
+    return tagged(name,tag);
+  return tagged(suffixed(name,"_"+txt[v]),tag);
+}
+
+// name of the MCG output for the v-th value and the k-th threshold pair: 
+// as above, then with _MIN_MAX inserted if there is more than one pair
+
+static string outname ( const char *name, const string &tag, int v, int k )
+{
+  if (thr.size()==1)
+    return outname(name,tag,v);
+  return suffixed(outname(name,tag,v),"_" + to_string(thr[k].first) + "_" + to_string(thr[k].second));
+}
+
+/* ------------------------------------------------------ */
+
+// parses a comma-separated list of numbers into val (and their text into 
+// txt); returns false if an entry is empty
+
+static bool parselist ( const char *s, vector<double> &val, vector<string> &txt )
+{
+  val.clear();
+  txt.clear();
+  string l = s;
+  size_t b = 0;
+  while (1)
+    {
+      size_t e = l.find(',',b);
+      string t = l.substr(b,e==string::npos ? string::npos : e-b);
+      if (t.empty())
+	return false;
+      txt.push_back(t);
+      val.push_back(atof(t.c_str()));
+      if (e==string::npos)
+	return true;
+      b = e+1;
+    }
+}
+
+/* ------------------------------------------------------ */
+
+// a Morse set in a file saved by tgraph::saveMorseSets: its type, the 
+// number of its primitives and of their vertices, and their centroid
+
+class msetsum {
+ public:
+  int index, index2;
+  unsigned char stab;
+  bool bdry;
+  int prims, verts;
+  vec3dd c;
+
+  msetsum() : index(0), index2(0), stab(0), bdry(false), prims(0), verts(0), c(0,0,0) {}
+};
+
+// reads the Morse sets in file name into s, by ID, and the length of the 
+// diagonal of their bounding box into diam; false if it can't be opened
+
+static bool readsets ( const char *name, map<int,msetsum> &s, double *diam )
+{
+  ifstream ifs(name,ios::binary);
+  if (!ifs)
+    return false;
+
+  vec3dd lo(0,0,0), hi(0,0,0);
+  bool first = true;
+  s.clear();
+  while (1)
+    {
+      primitive p(ifs);
+      if (!p)
+	break;
+      msetsum &m = s[p.id];
+      if (!m.prims)
+	{
+	  m.index = p.index;
+	  m.index2 = p.index2;
+	  m.stab = p.stab;
+	  m.bdry = p.bdry;
+	}
+      m.prims++;
+      for ( int k=0; k<p.verts; k++ )
+	{
+	  m.verts++;
+	  m.c += p.buf[k];
+	  for ( int l=0; l<3; l++ )
+	    {
+	      if (first || lo[l]>p.buf[k][l]) lo[l] = p.buf[k][l];
+	      if (first || hi[l]<p.buf[k][l]) hi[l] = p.buf[k][l];
+	    }
+	  first = false;
+	}
+    }
+  for ( map<int,msetsum>::iterator i=s.begin(); i!=s.end(); ++i )
+    i->second.c *= 1.0/i->second.verts;
+  *diam = (hi-lo).norm();
+  return true;
+}
+
+// order of Morse set summaries for validatesets: by type, numbers of 
+// primitives and vertices, then by the x coordinate of the centroid
+
+static bool _before ( const msetsum &x, const msetsum &y )
+{
+  if (x.index!=y.index) return x.index<y.index;
+  if (x.index2!=y.index2) return x.index2<y.index2;
+  if (x.stab!=y.stab) return x.stab<y.stab;
+  if (x.bdry!=y.bdry) return x.bdry<y.bdry;
+  if (x.prims!=y.prims) return x.prims<y.prims;
+  if (x.verts!=y.verts) return x.verts<y.verts;
+  return x.c[0]<y.c[0];
+}
+
+// compares the Morse sets in out with the ones in ref and reports the 
+// differences to o. Sets match if they have the same type, the same 
+// numbers of primitives and vertices, and centroids closer than 1e-4 
+// times the size of ref's sets (their IDs may differ). Each set of out
+// gets the matching unused set of ref with the lowest ID
+
+static void validatesets ( ostream &o, const string &out, const string &ref )
+{
+  map<int,msetsum> a,b;
+  double da,db;
+  if (!readsets(out.c_str(),a,&da) || !readsets(ref.c_str(),b,&db))
+    {
+      o << "--validate: can't read " << out << " or " << ref << endl;
+      return;
+    }
+
+  // ref's sets by ID, and their positions sorted by _before; the candidates
+  // for a set of out are then a range of ord
+  int k,nb = b.size();
+  vector<int> id;
+  vector<msetsum> y;
+  for ( map<int,msetsum>::iterator j=b.begin(); j!=b.end(); ++j )
+    {
+      id.push_back(j->first);
+      y.push_back(j->second);
+    }
+  vector<int> ord(nb);
+  for ( k=0; k<nb; k++ )
+    ord[k] = k;
+  sort(ord.begin(),ord.end(),[&]( int p, int q ) 
+       { return _before(y[p],y[q]) || (!_before(y[q],y[p]) && p<q); });
+
+  double tol = 1e-4*db;
+  int match = 0;
+  vector<bool> used(nb,false);
+  vector<int> extra;
+  for ( map<int,msetsum>::iterator i=a.begin(); i!=a.end(); ++i )
+    {
+      msetsum lo = i->second;
+      lo.c[0] -= tol;
+      msetsum hi = i->second;
+      hi.c[0] += tol;
+      int best = -1;
+      vector<int>::iterator j = lower_bound(ord.begin(),ord.end(),lo,[&]( int p, const msetsum &x ) 
+					    { return _before(y[p],x); });
+      for ( ; j!=ord.end() && !_before(hi,y[*j]); ++j )
+	if (!used[*j] && (best<0 || *j<best) && (i->second.c-y[*j].c).norm()<=tol)
+	  best = *j;
+      if (best<0)
+	extra.push_back(i->first);
+      else
+	{
+	  used[best] = true;
+	  match++;
+	}
+    }
+
+  o << "Validation against " << ref << ": " << match << " of " << a.size() << " Morse sets match (" 
+    << b.size() << " in " << ref << ")" << endl;
+  for ( k=0; k<extra.size(); k++ )
+    {
+      const msetsum &x = a[extra[k]];
+      o << "  only in " << out << ": Morse set " << extra[k] << " (index " << x.index << "/" << x.index2 
+	<< ", " << x.prims << " primitives, centroid " << x.c << ")" << endl;
+    }
+  for ( k=0; k<nb; k++ )
+    if (!used[k])
+      o << "  only in " << ref << ": Morse set " << id[k] << " (index " << y[k].index << "/" << y[k].index2 
+	<< ", " << y[k].prims << " primitives, centroid " << y[k].c << ")" << endl;
+}
+
+/* ------------------------------------------------------ */
+
+// shortest text that reads back as x
+
+static string exact ( double x )
+{
+  char buf[32];
+  for ( int p=6; p<17; p++ )
+    {
+      snprintf(buf,sizeof(buf),"%.*g",p,x);
+      if (strtod(buf,NULL)==x)
+	return buf;
+    }
+  snprintf(buf,sizeof(buf),"%.17g",x);
+  return buf;
+}
+
+// the options the field for value v is built with, in the form they are
+// given on the command line; checkpoints record them
+
+static string fieldoptions ( int v )
+{
+  ostringstream s;
+  if (type=='v')
+    s << "-v ";
+  if (sopt)
+    s << "-s " << exact(R[v]) << " ";
+  else
+    if (hopt)
+      s << "-h " << exact(wt[v]) << " ";
+    else
+      if (eopt)
+	s << "-e " << exact(wt[v]) << " ";
+  if (osys)
+    s << "-o ";
+  string res = s.str();
+  if (res.size())
+    res.erase(res.size()-1);
+  return res;
+}
+
+/* ------------------------------------------------------ */
+
+// the decomposition for the v-th -s/-h/-e value (v=0 if none of them is 
+// used): derives its field from base and writes its messages to o; arg 
+// holds the arguments starting at the input file name, narg of them, and
+// tag goes into output names (see tagged). In a time series, fa holds the 
+// coarse face arcs for the value, and changed marks the faces of base 
+// changed since the previous frame
+
+static void run ( pcvf *base, int v, char **arg, int narg, ostream &o, const string &tag, farcs *fa, const bool *changed )
+{
+  int j;
+  int ic[7] = { 0, 0, 0, 0, 0, 0, 0 };
+  int bc[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+  pcvf *m;
+  if (sopt)
+    m = new pcstable(R[v],base,!osys);
+  else
+    if (hopt)
+      m = new pchull(wt[v],base,!osys);
+    else
+      if (eopt)
+	m = new pcenv(wt[v],base,!osys);
+      else
+	m = new pcvf(base);
+
+  string ck = ckpt ? outname(ckpt,tag,v) : "";
+  string fo = fieldoptions(v);
+
+  tgraph *t;
+  int first = 1;
+
+  if (resume)
+    {
+      int saved;
+      t = new tgraph(m,resume,&saved,fo.c_str());
+      if ((copt || qopt) && t->ispruned())
+	{
+	  o << "Checkpoint " << resume << " was saved without -c and can't be used to compute connections" << endl;
+	  delete t;
+	  return;
+	}
+      o << "Resuming from " << resume << " after iteration " << saved << endl;
+      first = saved+1;
+    }
+  else
+    {
+      if (fa)
+	{
+	  // the faces of m whose arcs may differ from the previous frame's
+	  bool *ch = NULL;
+	  if (changed)
+	    {
+	      ch = new bool[m->faces()];
+	      for ( j=0; j<m->faces(); j++ )
+		ch[j] = changed[j];
+	      m->spread_changes(ch);
+	    }
+	  t = new tgraph(m,fa,ch);
+	  if (ch) delete[] ch;
+	}
+      else
+	t = new tgraph(m);
+      t->computeSCCs();
+      if (ckpt) t->save(ck.c_str(),0,fo.c_str());
+    }
+  t->set_log(o);
+
+  // refinement kernels with the field calls bound to its class
+  if (sopt)
+    t->specialize<pcstable>();
+  else
+    if (hopt)
+      t->specialize<pchull>();
+    else
+      if (eopt)
+	t->specialize<pcenv>();
+      else
+	t->specialize<pcvf>();
+
+  int iters = atoi(arg[1]);
+  assert(iters>=0);
+
+  o << "Subdivision: " << endl;
+  for ( j=first; j<=iters; j++ )
+    {
+      o << j << ": " << flush;
+      o << " --> " << t->nodes() << "/" << t->arcs() << flush;
+      if (budget)
+	{
+	  int refined = t->subdivide_scc_nodes(budget);
+	  if (!refined)
+	    {
+	      o << endl << "Memory budget reached, stopping refinement at " << t->memory()/1048576 << "MB" << endl;
+	      break;
+	    }
+	  if (refined<t->SCCs())
+	    o << " [" << refined << "/" << t->SCCs() << " SCCs]" << flush;
+	}
+      else
+	t->subdivide_scc_nodes();
+      o << " --> " << t->nodes() << "/" << t->arcs() << flush;
+      t->computeSCCs();
+      if (!copt && !qopt)
+	t->remove_all_nonSCC();
+      o << " --> " << t->nodes() << "/" << t->arcs() << endl;
+      if (ckpt) t->save(ck.c_str(),j,fo.c_str());
+    }
+
+  o << endl;
+
+  if (rtree)
+    {
+      // the other radii, decreasing; the Morse sets for each are inside 
+      // the ones for the previous one, on the nodes refined for R[v]
+      vector<int> ord;
+      for ( j=0; j<R.size(); j++ )
+	if (j!=v)
+	  ord.push_back(j);
+      sort(ord.begin(),ord.end(),[]( int a, int b ) { return R[a]>R[b]; });
+      vector<vfield_base*> f;
+      for ( j=0; j<ord.size(); j++ )
+	f.push_back(new pcstable(R[ord[j]],base,!osys));
+      t->computeRadiusTree(f);
+      for ( j=0; j<f.size(); j++ )
+	delete f[j];
+      o << "Morse sets by radius: " << endl;
+      for ( j=0; j<t->radiusLevels(); j++ )
+	o << " " << Rtext[j ? ord[j-1] : v] << ": " << t->radiusSCCs(j) << endl;
+      o << endl;
+    }
+
+  t->coarsenMorseSets();
+
+  t->computeSCCs();
+  t->computeMSTypes();
+
+  int totali = 0;
+  int totali2 = 0;
+
+  for ( j=0; j<t->SCCs(); j++ )
+    {
+      totali += t->MStype(j).getindex();
+      totali2 += t->MStype(j).getindex2();
+      new_MS(t->MStype(j),ic,bc);
+    }
+
+  o << "Total index: " << totali << " " << totali2 << endl;
+  print_statistics(o,ic,bc);
+  if (narg>2) t->saveMorseSets(outname(arg[2],tag,v).c_str());
+  if (validate) validatesets(o,outname(arg[2],tag,v),outname(validate,tag,v));
+  if (scctree) t->saveSCCtree(outname(scctree,tag,v).c_str());
+  if (rtree) t->saveRadiusTree(tagged(rtree,tag).c_str());
+
+  if (copt)
+    {
+      for ( j=0; j<thr.size(); j++ )
+	{
+	  if (thr.size()==1)
+	    o << "Computing MCG..." << endl;
+	  else
+	    o << "Computing MCG for -c " << thr[j].first << " " << thr[j].second << "..." << endl;
+	  t->prepare4MCG(thr[j].first,thr[j].second);
+	  tskel *MCG = t->MCG(inct);
+	  if (narg>3) t->saveSeparatrices(outname(arg[3],tag,v,j).c_str());
+	  if (narg>4) MCG->save(outname(arg[4],tag,v,j).c_str());
+	  delete MCG;
+	  if (j<thr.size()-1)
+	    o << endl;
+	}
+    }
+
+  if (qopt)
+    {
+      if (qa>=t->SCCs() || qb>=t->SCCs())
+	{
+	  o << "-q: there are only " << t->SCCs() << " Morse sets" << endl;
+	  delete t;
+	  return;
+	}
+      o << "Checking connection from Morse set " << qa << " to " << qb << "..." << endl;
+      if (t->connection(qa,qb,qlevel))
+	o << "Morse set " << qa << " may connect to Morse set " << qb << endl;
+      else
+	o << "Morse set " << qa << " does not connect to Morse set " << qb << endl;
+      if (narg>3) t->saveConnection(outname(arg[3],tag,v).c_str());
+    }
+
+  o << endl;
+
+  delete t;
+}
+
+/* ------------------------------------------------------ */
+
+// the number of runs out of cnt to do at the same time: as many as fit 
+// in physical memory with --mem-budget (which bounds the graph of each;
+// there is no telling how large it gets otherwise), 1 without it
+
+static int concurrent ( int cnt )
+{
+  if (cnt<=1 || !budget)
+    return 1;
+  double mem = (double)sysconf(_SC_PHYS_PAGES)*sysconf(_SC_PAGE_SIZE);
+  int par = mem/budget;
+  if (par>cnt)
+    par = cnt;
+  if (par>threads())
+    par = threads();
+  if (par<1)
+    par = 1;
+  return par;
+}
+
+/* ------------------------------------------------------ */
+
+// all runs for field fld (see run; fa then holds the face arcs of each 
+// value): one for each -s/-h/-e value, par of them at the same time (their
+// messages are then printed in order at the end), or with --radius-tree 
+// the one for the largest radius
+
+static void decompose ( pcvf *fld, char **arg, int narg, ostream &o, const string &tag, 
+			int par, vector<farcs> *fa, const bool *changed )
+{
+  int j;
+  int values = sopt ? R.size() : ((hopt || eopt) ? wt.size() : 1);
+
+  if (rtree)
+    {
+      // one run, for the largest radius; the others only enter the hierarchy
+      int v = max_element(R.begin(),R.end())-R.begin();
+      run(fld,v,arg,narg,o,tag,fa ? &(*fa)[v] : NULL,changed);
+    }
+  else
+    if (par==1)
+      for ( j=0; j<values; j++ )
+	{
+	  if (values>1)
+	    o << "---------- " << (sopt ? "-s " : (hopt ? "-h " : "-e ")) 
+	      << (sopt ? Rtext[j] : wttext[j]) << " ----------" << endl;
+	  run(fld,j,arg,narg,o,tag,fa ? &(*fa)[j] : NULL,changed);
+	}
+    else
+      {
+	// each run is serial
+	vector<ostringstream> log(values);
+	int nt = threads();
+	set_threads(par);
+	parallel_for(values,[&](int k, int) { run(fld,k,arg,narg,log[k],tag,fa ? &(*fa)[k] : NULL,changed); });
+	set_threads(nt);
+	for ( j=0; j<values; j++ )
+	  o << "---------- " << (sopt ? "-s " : (hopt ? "-h " : "-e ")) 
+	    << (sopt ? Rtext[j] : wttext[j]) << " ----------" << endl << log[j].str();
+      }
+}
 
 /* ------------------------------------------------------ */
 
@@ -205,9 +773,8 @@ int main ( int argc, char *argv[] )
 		  cout << "-c has to be followed by two nonnegative integers" << endl;
 		  return 0;
 		}
-	      minr = atoi(argv[i+1]);
-	      maxr = atoi(argv[i+2]);
-	      if (minr<0 || maxr<0)
+	      thr.push_back(make_pair(atoi(argv[i+1]),atoi(argv[i+2])));
+	      if (thr.back().first<0 || thr.back().second<0)
 		{
 		  cout << "-c has to be followed by two nonnegative integers" << endl;
 		  return 0;
@@ -224,12 +791,11 @@ int main ( int argc, char *argv[] )
 		  return 0;
 		}
 	      hopt = true;
-	      if (argc<i+2)
+	      if (argc<i+2 || !parselist(argv[i+1],wt,wttext))
 		{
-		  cout << "-h has to be followed by a floating point number" << endl;
+		  cout << "-h has to be followed by a floating point number (or a comma-separated list)" << endl;
 		  return 0;
 		}
-	      wt = atof(argv[i+1]);
 	      i += 2;
 	      break;
 	      
@@ -241,12 +807,11 @@ int main ( int argc, char *argv[] )
 		  return 0;
 		}
 	      sopt = true;
-	      if (argc<i+2)
+	      if (argc<i+2 || !parselist(argv[i+1],R,Rtext))
 		{
-		  cout << "-s has to be followed by a floating point number" << endl;
+		  cout << "-s has to be followed by a floating point number (or a comma-separated list)" << endl;
 		  return 0;
 		}
-	      R = atof(argv[i+1]);
 	      i += 2;
 	      break;
 
@@ -292,15 +857,134 @@ int main ( int argc, char *argv[] )
 		  return 0;
 		}
 	      eopt = true;
-	      if (argc<i+2)
+	      if (argc<i+2 || !parselist(argv[i+1],wt,wttext))
 		{
-		  cout << "-e has to be followed by a floating point number" << endl;
+		  cout << "-e has to be followed by a floating point number (or a comma-separated list)" << endl;
 		  return 0;
 		}
-	      wt = atof(argv[i+1]);
 	      i += 2;
 	      break;
 	      
+	    case 'q':
+	      if (argv[i][2])
+		{
+		  cout << "Unknown option: " << argv[i] << endl;
+		  print_usage();
+		  return 0;
+		}
+	      qopt = true;
+	      if (argc<i+4)
+		{
+		  cout << "-q has to be followed by three nonnegative integers" << endl;
+		  return 0;
+		}
+	      qa = atoi(argv[i+1]);
+	      qb = atoi(argv[i+2]);
+	      qlevel = atoi(argv[i+3]);
+	      if (qa<0 || qb<0 || qlevel<0)
+		{
+		  cout << "-q has to be followed by three nonnegative integers" << endl;
+		  return 0;
+		}
+	      if (qa==qb)
+		{
+		  cout << "-q needs two different Morse sets" << endl;
+		  return 0;
+		}
+	      i += 4;
+	      break;
+
+	    case 'j':
+	      if (argv[i][2])
+		{
+		  cout << "Unknown option: " << argv[i] << endl;
+		  print_usage();
+		  return 0;
+		}
+	      if (argc<i+2 || atoi(argv[i+1])<=0)
+		{
+		  cout << "-j has to be followed by a positive integer" << endl;
+		  return 0;
+		}
+	      set_threads(atoi(argv[i+1]));
+	      i += 2;
+	      break;
+
+	    case '-':
+	      // long options; each takes one argument
+	      if (argc<i+2)
+		{
+		  cout << argv[i] << " has to be followed by an argument" << endl;
+		  return 0;
+		}
+	      if (!strcmp(argv[i],"--save-checkpoint"))
+		{
+		  ckpt = argv[i+1];
+		  i += 2;
+		  break;
+		}
+	      if (!strcmp(argv[i],"--resume"))
+		{
+		  resume = argv[i+1];
+		  i += 2;
+		  break;
+		}
+	      if (!strcmp(argv[i],"--scc-tree"))
+		{
+		  scctree = argv[i+1];
+		  i += 2;
+		  break;
+		}
+	      if (!strcmp(argv[i],"--radius-tree"))
+		{
+		  rtree = argv[i+1];
+		  i += 2;
+		  break;
+		}
+	      if (!strcmp(argv[i],"--frames"))
+		{
+		  frames = argv[i+1];
+		  i += 2;
+		  break;
+		}
+	      if (!strcmp(argv[i],"--validate"))
+		{
+		  validate = argv[i+1];
+		  i += 2;
+		  break;
+		}
+	      if (!strcmp(argv[i],"--batch"))
+		{
+		  batch = argv[i+1];
+		  i += 2;
+		  break;
+		}
+	      if (!strcmp(argv[i],"--frame-tol"))
+		{
+		  ftol = atof(argv[i+1]);
+		  if (ftol<0)
+		    {
+		      cout << "--frame-tol has to be followed by a nonnegative number" << endl;
+		      return 0;
+		    }
+		  i += 2;
+		  break;
+		}
+	      if (!strcmp(argv[i],"--mem-budget"))
+		{
+		  budget = atof(argv[i+1])*1048576;
+		  if (budget<=0)
+		    {
+		      cout << "--mem-budget has to be followed by a positive number of megabytes" << endl;
+		      return 0;
+		    }
+		  i += 2;
+		  break;
+		}
+	      cout << "Unknown option: " << argv[i] << endl;
+	      print_usage();
+	      return 0;
+
 	    default:
 	      cout << "Unknown option:" << argv[i] << endl;
 	      print_usage();
@@ -314,7 +998,16 @@ int main ( int argc, char *argv[] )
     while(1);
   }
 
-  pcvf *m = NULL;
+  if (copt && qopt)
+    {
+      cout << "-q can't be combined with -c" << endl;
+      return 0;
+    }
+
+  // thresholds in increasing order, so that each prepare4MCG call only
+  // refines further what the previous one did
+  sort(thr.begin(),thr.end());
+  thr.erase(unique(thr.begin(),thr.end()),thr.end());
 
   if (argc<i+2)
     {
@@ -322,75 +1015,137 @@ int main ( int argc, char *argv[] )
       return 0;
     }
 
-  if (sopt)
-    m = new pcstable(R,argv[i],type,!osys);
-  else
-    if (hopt)
-      m = new pchull(wt,argv[i],type,!osys);
-    else
-      if (eopt)
-	{
-	  if (type=='f')
-	    {
-	      cout << "Envelope option is available only with vertex-based vector fields (-v option)" << endl;
-	      return 0;
-	    }
-	  m = new pcenv(wt,argv[i],!osys);
-	}
-      else
-	m = new pcvf(argv[i],type,!osys);
-
-  tgraph t(m);
-  t.computeSCCs();
+  if (validate && argc<i+3)
+    {
+      cout << "--validate needs OUT-MD" << endl;
+      return 0;
+    }
 
-  int iters = atoi(argv[i+1]);
-  assert(iters>=0);
+  if (eopt && type=='f')
+    {
+      cout << "Envelope option is available only with vertex-based vector fields (-v option)" << endl;
+      return 0;
+    }
 
-  cout << "Subdivision: " << endl;
-  for ( j=1; j<=iters; j++ )
+  if (rtree && !sopt)
     {
-      cout << j << ": " << flush;
-      cout << " --> " << t.nodes() << "/" << t.arcs() << flush;
-      t.subdivide_scc_nodes();
-      cout << " --> " << t.nodes() << "/" << t.arcs() << flush;
-      t.computeSCCs();
-      if (!copt)
-	t.remove_all_nonSCC();
-      cout << " --> " << t.nodes() << "/" << t.arcs() << endl;
+      cout << "--radius-tree can only be used with -s" << endl;
+      return 0;
     }
 
-  cout << endl;
+  int values = sopt ? R.size() : ((hopt || eopt) ? wt.size() : 1);
+  if (resume && values>1)
+    {
+      cout << "--resume can't be used with a list of values" << endl;
+      return 0;
+    }
+  if (resume && (frames || batch))
+    {
+      cout << "--resume can't be used with --frames or --batch" << endl;
+      return 0;
+    }
+  if (frames && batch)
+    {
+      cout << "--frames can't be combined with --batch" << endl;
+      return 0;
+    }
 
-  t.coarsenMorseSets();
+  ifstream fifs;
+  if (frames)
+    {
+      fifs.open(frames);
+      if (!fifs)
+	{
+	  cout << "Can't open file " << frames << endl;
+	  return 0;
+	}
+    }
 
-  t.computeSCCs();
-  t.computeMSTypes();
+  // with --batch, the files with the vectors of the fields after IN's own
+  vector<string> fields;
+  if (batch)
+    {
+      ifstream lifs(batch);
+      if (!lifs)
+	{
+	  cout << "Can't open file " << batch << endl;
+	  return 0;
+	}
+      string l;
+      while (getline(lifs,l))
+	if (!l.empty())
+	  fields.push_back(l);
+    }
 
-  int totali = 0;
-  int totali2 = 0;
+  // the input is read and the base field computed once; the stable, hull
+  // and envelope fields for each value are derived from it
+  pcvf *base = new pcvf(argv[i],type,!osys);
 
-  for ( j=0; j<t.SCCs(); j++ )
+  if (batch)
     {
-      totali += t.MStype(j).getindex();
-      totali2 += t.MStype(j).getindex2();
-      new_MS(t.MStype(j));
+      // field 0 is IN's own, the others share its mesh and are built by 
+      // the runs for them; only their per-field data (vectors, flow and 
+      // vertex data, graphs) take more memory
+      int cnt = fields.size()+1;
+      int par = concurrent(cnt);
+      if (par==1)
+	for ( j=0; j<cnt; j++ )
+	  {
+	    cout << "========== field " << j << ": " << (j ? fields[j-1].c_str() : argv[i]) << " ==========" << endl;
+	    pcvf *fld = j ? new pcvf(base,fields[j-1].c_str(),type,!osys) : base;
+	    decompose(fld,argv+i,argc-i,cout,"_b"+to_string(j),concurrent(values),NULL,NULL);
+	    if (j) delete fld;
+	  }
+      else
+	{
+	  // each field is serial; their messages are printed in order at the end
+	  vector<ostringstream> log(cnt);
+	  int nt = threads();
+	  set_threads(par);
+	  parallel_for(cnt,[&](int k, int)
+		       {
+			 pcvf *fld = k ? new pcvf(base,fields[k-1].c_str(),type,!osys) : base;
+			 decompose(fld,argv+i,argc-i,log[k],"_b"+to_string(k),1,NULL,NULL);
+			 if (k) delete fld;
+		       });
+	  set_threads(nt);
+	  for ( j=0; j<cnt; j++ )
+	    cout << "========== field " << j << ": " << (j ? fields[j-1].c_str() : argv[i]) << " ==========" << endl << log[j].str();
+	}
+      delete base;
+      return 0;
     }
 
-  cout << "Total index: " << totali << " " << totali2 << endl;
-  print_statistics();
-  if (argc>i+2) t.saveMorseSets(argv[i+2]);
-
-  if (copt)
+  // the input's own vectors are frame 0; each frame after it updates base
+  int par = concurrent(values);
+  vector<farcs> fa(frames ? values : 0);
+  bool *changed = NULL;
+  for ( int frame=0; ; frame++ )
     {
-      cout << "Computing MCG..." << endl;
-      t.prepare4MCG(minr,maxr);
-      tskel *MCG = t.MCG(inct);
-      if (argc>i+3) t.saveSeparatrices(argv[i+3]);
-      if (argc>i+4) MCG->save(argv[i+4]);
-      delete MCG;
+      if (frame)
+	{
+	  if (!changed)
+	    changed = new bool[base->faces()];
+	  if (!base->update(fifs,type,ftol,!osys,changed))
+	    break;
+	  int cnt = 0;
+	  for ( j=0; j<base->faces(); j++ )
+	    cnt += changed[j];
+	  cout << "========== frame " << frame << ": " << cnt << " faces changed ==========" << endl;
+	}
+      else
+	if (frames)
+	  cout << "========== frame 0 ==========" << endl;
+
+      decompose(base,argv+i,argc-i,cout,frames ? "_f"+to_string(frame) : "",par,frames ? &fa : NULL,changed);
+
+      if (!frames)
+	break;
     }
+  if (changed)
+    delete[] changed;
 
-  cout << endl;
+  delete base;
 
   return 0;
 }
@@ -25,37 +25,56 @@
 */
 
 #include <mesh.h>
+#include <binfile.h>
+#include <parallel.h>
 #include <fstream>
 #include <iostream>
 #include <cassert>
+#include <cstdlib>
 
 using namespace std;
 
 /* ------------------------------------------------------ */
 
-mesh::mesh ( const char *name ) : mesh_base(), ifs(name)
+mesh::mesh ( const char *name ) : mesh_base(), ifs(), bin(NULL)
 {
-  if (!ifs) 
+  if (binfile::isbinary(name))
     {
-      cout << "Can't open " << name << endl;
-      assert(ifs);
+      bin = new binfile(name);
+      read_from_binary();
     }
-
-  // detect format
-  char c = ifs.get();
-  char format;
-
-  if (c=='n')
-    format = 'n';
   else
     {
-      ifs.putback(c);
-      format = 't';
+      ifs.open(name);
+      if (!ifs) 
+	{
+	  cout << "Can't open " << name << endl;
+	  assert(ifs);
+	}
+
+      // detect format
+      char c = ifs.get();
+      char format;
+
+      if (c=='n')
+	format = 'n';
+      else
+	{
+	  ifs.putback(c);
+	  format = 't';
+	}
+
+      read_from_file(ifs,format);
     }
 
-  read_from_file(ifs,format);
-
   compute_normals();
+  compute_facegeometry();
+}
+
+/* ------------------------------------------------------ */
+
+mesh::mesh ( const mesh *m ) : mesh_base(m), ifs(), bin(NULL), v(m->v), n(m->n), fv(m->fv), fe(m->fe), grefs(m->grefs)
+{
 }
 
 /* ------------------------------------------------------ */
@@ -85,7 +104,7 @@ void mesh::read_from_file ( ifstream &ifs, char format )
 	    cout << "Warning: nused vertices detected" << endl;
 	  }
 
-	v = new vec3dd[vtcs];
+	v = new vec3dg[(unsigned)vtcs];
 	for ( i=0; i<vtcs; i++ )
 	  ifs >> v[i][0] >> v[i][1] >> v[i][2];
       }
@@ -115,7 +134,7 @@ void mesh::read_from_file ( ifstream &ifs, char format )
 	    cout << "Warning: nused vertices detected" << endl;
 	  }
 
-	v = new vec3dd[vtcs];
+	v = new vec3dg[(unsigned)vtcs];
 	for ( i=0; i<vtcs; i++ )
 	  ifs >> v[i][0] >> v[i][1] >> v[i][2];
       }
@@ -124,9 +143,47 @@ void mesh::read_from_file ( ifstream &ifs, char format )
 
 /* ------------------------------------------------------ */
 
+void mesh::read_from_binary()
+{
+  int i;
+
+  for ( i=0; i<bin->h.faces; i++ )
+    {
+      int b = bin->first(i);
+      int e = bin->first(i+1);
+      if (e-b<3)
+	{
+	  cout << "Face " << i << " has fewer than 3 vertices" << endl;
+	  exit(1);
+	}
+      vector<int> *t = new vector<int>;
+      for ( int k=b; k<e; k++ )
+	{
+	  if (bin->index(k)<0 || bin->index(k)>=bin->h.vertices)
+	    {
+	      cout << "Vertex index out of range in face " << i << endl;
+	      exit(1);
+	    }
+	  t->push_back(bin->index(k));
+	}
+      add_2Dmel(t);
+    }
+  finalize();
+
+  if (bin->h.vertices!=vtcs)
+    {
+      cout << "Warning: nused vertices detected" << endl;
+    }
+
+  v = new vec3dg[(unsigned)vtcs];
+  parallel_for(vtcs,[&](int i, int) { v[i] = bin->coordinate(i); });
+}
+
+/* ------------------------------------------------------ */
+
 vec3dd mesh::evec ( const mesh_element *f, int i, int j )
 {
-  return v[f->face[j]->ID]-v[f->face[i]->ID];
+  return vertex(f->face[j]->ID)-vertex(f->face[i]->ID);
 }
 
 /* ------------------------------------------------------ */
@@ -134,7 +191,17 @@ vec3dd mesh::evec ( const mesh_element *f, int i, int j )
 vec3dd mesh::edgepoint ( int eid, double t )
 {
   mesh_element *e = getedge(eid);
-  return (1-t)*v[e->face[0]->ID]+t*v[e->face[1]->ID];
+  return (1-t)*vertex(e->face[0]->ID)+t*vertex(e->face[1]->ID);
+}
+
+/* ------------------------------------------------------ */
+
+vec3dd mesh::facepoint ( int fce, int eix, double t )
+{
+  if (eix&1)
+    return fv[(faceoffset(fce)>>1)+(eix>>1)];
+  const vec3dg *p = fe+faceoffset(fce)+eix;
+  return (1-t)*vec3dd(p[0])+t*vec3dd(p[1]);
 }
 
 /* ------------------------------------------------------ */
@@ -155,8 +222,8 @@ vec3dd mesh::normal ( int i )
 
 void mesh::compute_normals()
 {
-  n = new vec3dd[fcs];
-  for ( int i=0; i<fcs; i++ )
+  n = new vec3dg[(unsigned)fcs];
+  parallel_for(fcs,[&](int i, int)
     {
       vec3dd n0(0,0,0);
       const mesh_element *f = get(i);
@@ -164,7 +231,27 @@ void mesh::compute_normals()
 	n0 += evec(f,j,j+2)^evec(f,j,j+4);
       n0.normalize();
       n[i] = n0;
-    }
+    });
+}
+
+/* ------------------------------------------------------ */
+
+void mesh::compute_facegeometry()
+{
+  fv = new vec3dg[(unsigned)faceoffset(fcs)>>1];
+  fe = new vec3dg[(unsigned)faceoffset(fcs)];
+  parallel_for(fcs,[&](int i, int)
+    {
+      const mesh_element *f = get(i);
+      vec3dg *pv = fv+(faceoffset(i)>>1);
+      vec3dg *pe = fe+faceoffset(i);
+      for ( int j=0; j<f->faces; j+=2 )
+	{
+	  pe[j] = v[f->face[j]->face[0]->ID];
+	  pe[j+1] = v[f->face[j]->face[1]->ID];
+	  pv[j>>1] = v[f->face[j+1]->ID];
+	}
+    });
 }
 
 /* ------------------------------------------------------ */
@@ -187,9 +274,16 @@ void mesh::print_out()
 
 mesh::~mesh()
 {
+  if (bin) delete bin;
+  bin = NULL;
+  if (!grefs.release())
+    return;
   if (v) delete[] v;
   if (n) delete[] n;
   v = n = NULL;
+  if (fv) delete[] fv;
+  if (fe) delete[] fe;
+  fv = fe = NULL;
 }
 
 /* ------------------------------------------------------ */
@@ -32,6 +32,8 @@
 #include <mesh_base.h>
 #include <vec3d.h>
 
+class binfile;
+
 /* ------------------------------------------------------ */
 
 class mesh : public mesh_base {
@@ -41,22 +43,34 @@ class mesh : public mesh_base {
   // format: 'n' - polygonal mesh file
   // like .t but faces terminated with -1
   // file in n format starts with 'n'
+  void read_from_binary();   // from bin
 
 
   void compute_normals();
+  void compute_facegeometry();
 
   vec3dd evec ( const mesh_element *f, int i, int j );
 
  protected:
 
   std::ifstream ifs;
+  binfile *bin;   // the input, if it is in the binary format; the vectors are read from it by pcvf
+
+  vec3dg *v;  // vertex coordinates
+  vec3dg *n;  // unit normals for the faces
 
-  vec3dd *v;  // vertex coordinates
-  vec3dd *n;  // unit normals for the faces
+  // per-face copies of the coordinates, in face order: for face i, fv
+  // holds its vertices from faceoffset(i)/2 on and fe the two endpoints 
+  // (edge's face[0], face[1]) of each edge from faceoffset(i) on
+  vec3dg *fv;
+  vec3dg *fe;
+
+  refcount grefs;  // meshes sharing v, n, fv and fe
 
  public:
 
   mesh ( const char *name ); 
+  mesh ( const mesh *m );   // shares m's topology and geometry (m can be deleted first)
   ~mesh();
 
   void print_out();
@@ -64,6 +78,10 @@ class mesh : public mesh_base {
   // returns point on edge eid 
   vec3dd edgepoint ( int eid, double t );  
 
+  // boundary element eix of face fce: the vertex for odd eix, the point
+  // edgepoint() returns for parameter t for even eix; reads fv/fe only
+  vec3dd facepoint ( int fce, int eix, double t = 0 );
+
   vec3dd vertex ( int i ); // vertex coordinate
   vec3dd normal ( int i ); // face normal
 };
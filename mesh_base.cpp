@@ -88,7 +88,7 @@ int i4cmp ( const void *a0, const void *b0 )
 /* ------------------------------------------------------ */
 
 mesh_element::mesh_element ( int id, int dim ) :
-  ID(id), dimension(dim), faces(0), cofaces(0), face(NULL), coface(NULL)
+  ID(id), dimension(dim), faces(0), cofaces(0), face(NULL), coface(NULL), cofix(NULL)
 {}
 
 void mesh_element::set_faces ( int n, mesh_element **f )
@@ -127,11 +127,44 @@ mesh_element::~mesh_element()
   if (coface)
     delete[] coface;
   coface = NULL;
+  if (cofix)
+    delete[] cofix;
+  cofix = NULL;
 }
 
 /* ------------------------------------------------------ */
 
-mesh_base::mesh_base() : mel(), workspace(new std::vector<std::vector<int>*>)
+refcount::refcount() : cnt(new int(1))
+{}
+
+refcount::refcount ( const refcount &r ) : cnt(r.cnt)
+{
+  __atomic_add_fetch(cnt,1,__ATOMIC_RELAXED);
+}
+
+refcount::~refcount()
+{}
+
+bool refcount::release()
+{
+  if (!cnt)
+    return false;
+  bool last = __atomic_sub_fetch(cnt,1,__ATOMIC_ACQ_REL)==0;
+  if (last)
+    delete cnt;
+  cnt = NULL;
+  return last;
+}
+
+/* ------------------------------------------------------ */
+
+mesh_base::mesh_base() : mel(), workspace(new std::vector<std::vector<int>*>), foff(NULL), fdeg(0)
+{}
+
+/* ------------------------------------------------------ */
+
+mesh_base::mesh_base ( const mesh_base *m ) : 
+  workspace(NULL), vtcs(m->vtcs), es(m->es), fcs(m->fcs), mel(m->mel), foff(m->foff), fdeg(m->fdeg), refs(m->refs)
 {}
 
 /* ------------------------------------------------------ */
@@ -168,6 +201,18 @@ mesh_element * mesh_base::getface ( int i )
 
 /* ------------------------------------------------------ */
 
+int mesh_base::faceoffset ( int i )
+{
+  return foff[i];
+}
+
+int mesh_base::facedegree()
+{
+  return fdeg;
+}
+
+/* ------------------------------------------------------ */
+
 void mesh_base::add_2Dmel ( std::vector<int> *verts )
 {
   assert(workspace);
@@ -445,6 +490,29 @@ void mesh_base::finalize()
 
   vtcs = maxvid;
 
+  // local indices of elements in their cofaces
+  for ( i=0; i<mel.size(); i++ )
+    if (mel[i]->cofaces)
+      mel[i]->cofix = new int[mel[i]->cofaces];
+  for ( i=0; i<fcs+es; i++ )
+    for ( j=0; j<mel[i]->faces; j++ )
+      {
+	mesh_element *m = mel[i]->face[j];
+	for ( k=0; k<m->cofaces; k++ )
+	  if (m->coface[k]==mel[i])
+	    m->cofix[k] = j;
+      }
+
+  foff = new int[fcs+1];
+  foff[0] = 0;
+  for ( i=0; i<fcs; i++ )
+    foff[i+1] = foff[i]+c2[i]->faces;
+
+  fdeg = fcs ? c2[0]->faces/2 : 0;
+  for ( i=0; i<fcs; i++ )
+    if (c2[i]->faces!=2*fdeg)
+      fdeg = 0;
+
   // clear workspace etc
   delete[] e;
   delete[] sec;
@@ -488,6 +556,10 @@ void mesh_base::print_out()
 mesh_base::~mesh_base()
 {
   if (workspace) delete workspace;
+  if (!refs.release())
+    return;
+  if (foff) delete[] foff;
+  foff = NULL;
   for ( int i=0; i<mel.size(); i++ )
     {
       if (mel[i])
@@ -44,6 +44,7 @@ class mesh_element {
 
   int cofaces;
   mesh_element** coface; // ALL cofaces; for a vertex, in order around it
+  int *cofix;            // cofix[k]: index of this element in coface[k]->face
 
   mesh_element ( int id, int dim );
   ~mesh_element();
@@ -60,6 +61,32 @@ class mesh_element {
 
 /* ------------------------------------------------------ */
 
+// number of objects sharing some data (see the copy constructors of 
+// mesh_base, mesh and pcvf); copying adds a reference, release() drops 
+// one. Thread safe, so that objects sharing data can be used and deleted
+// by different threads
+
+class refcount {
+
+  int *cnt;
+
+ public:
+
+  refcount();   // a single reference
+  refcount ( const refcount &r );
+  ~refcount();
+
+  // drops this reference; true if it was the last one (the shared data 
+  // should be freed then)
+  bool release();
+
+ private:
+
+  refcount & operator= ( const refcount & );
+};
+
+/* ------------------------------------------------------ */
+
 // assumes manifold mesh, with planar 2D cells
 
 class mesh_base {
@@ -70,6 +97,9 @@ class mesh_base {
 
   int vtcs, es, fcs;
   std::vector<mesh_element*> mel;  // mesh elements in decreasing dimension order (2,1,0)
+  int *foff;  // per face: sum of ->faces over the preceding faces; foff[fcs] is the total
+  int fdeg;   // number of edges of every face, or 0 if faces differ in that
+  refcount refs;  // mesh_bases sharing mel and foff
 
   void add_2Dmel ( std::vector<int> *verts );   // adds a 2D mesh element
   void finalize();    // finalizes the datastructure; 
@@ -79,6 +109,7 @@ class mesh_base {
  public:
 
   mesh_base ( );      
+  mesh_base ( const mesh_base *m );   // shares m's elements and offsets (m can be deleted first)
   ~mesh_base();
 
   mesh_element * get ( int i ); // get mesh element i
@@ -86,6 +117,14 @@ class mesh_base {
   mesh_element * getvertex ( int i );
   mesh_element * getface ( int i ); 
 
+  // offset of face i's boundary elements in flat per-face arrays 
+  // (with one entry per boundary element); always even
+  int faceoffset ( int i );
+
+  // 3 for triangle meshes, 4 for quad meshes etc.; 0 if not all faces
+  // have the same number of edges
+  int facedegree();
+
   void print_out();
 
   int vertices();
@@ -0,0 +1,68 @@
+
+
+/*
+ * MDPC (Morse Decompositions for Piecewise Constant vector fields)
+ * Copyright (c) 2012  Andrzej Szymczak
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included 
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+ * ANDRZEJ SZYMCZAK BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF 
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ *
+*/
+
+#include <parallel.h>
+
+/* ------------------------------------------------------ */
+
+static int nthreads = 0;   // 0: not set, use hardware concurrency
+static thread_local bool inpar = false;
+
+/* ------------------------------------------------------ */
+
+int threads()
+{
+  if (nthreads<=0)
+    {
+      nthreads = std::thread::hardware_concurrency();
+      if (nthreads<=0)
+	nthreads = 1;
+    }
+  return nthreads;
+}
+
+/* ------------------------------------------------------ */
+
+void set_threads ( int t )
+{
+  nthreads = t;
+}
+
+/* ------------------------------------------------------ */
+
+bool in_parallel()
+{
+  return inpar;
+}
+
+/* ------------------------------------------------------ */
+
+void _set_in_parallel ( bool p )
+{
+  inpar = p;
+}
+
+/* ------------------------------------------------------ */
@@ -0,0 +1,86 @@
+
+
+/*
+ * MDPC (Morse Decompositions for Piecewise Constant vector fields)
+ * Copyright (c) 2012  Andrzej Szymczak
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included 
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+ * ANDRZEJ SZYMCZAK BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF 
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ *
+*/
+
+#ifndef __PARALLEL_H
+#define __PARALLEL_H
+
+#include <global.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+/* ------------------------------------------------------ */
+
+// number of worker threads used by parallel_for; defaults to the 
+// number of hardware threads
+int threads();
+void set_threads ( int t );
+
+// true when called from a parallel_for worker
+bool in_parallel();
+void _set_in_parallel ( bool p );
+
+/* ------------------------------------------------------ */
+
+// calls f(i,t) for i=0,...,cnt-1 on up to threads() workers; t<threads() is
+// the index of the worker, for per-worker scratch space. Iterations are 
+// handed out in chunks in no particular order, so results must not depend 
+// on it. Nested calls run serially, with t=0.
+
+template<class F>
+void parallel_for ( int cnt, F f )
+{
+  int t = threads();
+  if (t>cnt)
+    t = cnt;
+
+  if (t<=1 || in_parallel())
+    {
+      for ( int i=0; i<cnt; i++ )
+	f(i,0);
+      return;
+    }
+
+  int chunk = cnt/(16*t)+1;
+  std::atomic<int> next(0);
+  std::vector<std::thread> w;
+
+  for ( int k=0; k<t; k++ )
+    w.push_back(std::thread([&,k]()
+			    {
+			      _set_in_parallel(true);
+			      int s;
+			      while ((s=next.fetch_add(chunk))<cnt)
+				for ( int i=s; i<s+chunk && i<cnt; i++ )
+				  f(i,k);
+			    }));
+  for ( int k=0; k<t; k++ )
+    w[k].join();
+}
+
+/* ------------------------------------------------------ */
+
+#endif
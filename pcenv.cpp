@@ -24,6 +24,7 @@
 */
 
 #include <pcenv.h>
+#include <parallel.h>
 #include <iostream>
 
 using namespace std;
@@ -34,21 +35,44 @@ pcenv::~pcenv() {}
 
 /* ------------------------------------------------------ */
 
+void pcenv::spread_changes ( bool *changed )
+{
+}
+
+/* ------------------------------------------------------ */
+
 pcenv::pcenv ( double weight, const char *name, bool BD ) :
-  pchull(weight,name,'v',BD)
+  pchull(weight,name,BD)
 {
-  F0 = new vector<vec3dd>[faces()];
+  envvectors();
+  initialize(BD);
+}
+
+/* ------------------------------------------------------ */
 
-  for ( int i=0; i<faces(); i++ )
+pcenv::pcenv ( double weight, const pcvf *base, bool BD ) :
+  pchull(weight,base)
+{
+  assert(pvf);
+  envvectors();
+  initialize(BD);
+}
+
+/* ------------------------------------------------------ */
+
+void pcenv::envvectors()
+{
+  parallel_for(faces(),[&](int i, int)
     {
       mesh_element *ff = getface(i);
+      vec3dd *F0i = F0+hulloffset(i);
       for ( int j=1; j<ff->faces; j+=2 )
 	{
 	  vec3dd vv = pvf[ff->face[j]->ID];
-	  F0[i].push_back(vv-(vv*n[i])*n[i]);
+	  F0i[j>>1] = vv-(vv*normal(i))*normal(i);
 	}
-    }
-  initialize(BD);
+      Fcnt[i] = ff->faces>>1;
+    });
 }
 
 /* ------------------------------------------------------ */
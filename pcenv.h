@@ -34,10 +34,18 @@
 
 class pcenv : public pchull
 {
+  void envvectors();   // F0 and Fcnt of pcenv
+
  public:
   
   pcenv ( double weight, const char *name, bool BD = true );
+  // same for the field base was read from, which has to be vertex-based
+  // (see pcvf ( const pcvf *base ))
+  pcenv ( double weight, const pcvf *base, bool BD );
   virtual ~pcenv();
+
+  // unlike pchull's, the hull of a face has the vectors of its vertices only
+  virtual void spread_changes ( bool *changed );
 };
 
 /* ------------------------------------------------------ */
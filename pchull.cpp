@@ -24,283 +24,377 @@
 */
 
 #include <pchull.h>
+#include <parallel.h>
 
 using namespace std;
 
 /* ------------------------------------------------------ */
 
-static bool _dotpositive ( const vec3dd &v, vector<vec3dd> *s )
+static bool _dotpositive ( const vec3dd &v, const vec3dg *s, int k )
 {
-  for ( int i=0; i<s->size(); i++ )
-    if (v*(*s)[i]>=0)
+  for ( int i=0; i<k; i++ )
+    if (v*vec3dd(s[i])>=0)
       return true;
   return false;
 }
 
-static bool _dotnegative ( const vec3dd &v, vector<vec3dd> *s )
+static bool _dotnegative ( const vec3dd &v, const vec3dg *s, int k )
 {
-  for ( int i=0; i<s->size(); i++ )
-    if (v*(*s)[i]<=0)
+  for ( int i=0; i<k; i++ )
+    if (v*vec3dd(s[i])<=0)
       return true;
   return false;
 }
 
 /* ------------------------------------------------------ */
 
-static bool _samesign ( double a, double b, double c )
+// positive if b is counterclockwise from a, looking from the tip of n
+static double _orient ( const vec3dd &n, const vec3dd &a, const vec3dd &b )
 {
-  return (a>=0 && b>=0 && c>=0) || (a<=0 && b<=0 && c<=0);
+  return (a^b)*n;
 }
 
-static bool _zeroinslab ( const vec3dd &n, const vec3dd &a, const vec3dd &b, const vec3dd &c )
+// angular sweep over the k vectors in s, all orthogonal to n: maintains
+// the smallest wedge (of angle less than pi) containing the vectors seen 
+// so far, with s[*r] and s[*l] on its clockwise and counterclockwise 
+// boundary; returns true as soon as no such wedge exists, i.e. when zero 
+// is in the hull of s
+static bool _sweep ( const vec3dd &n, const vec3dg *s, int k, int *r, int *l )
 {
-  vec3dd Nab = (b-a)^n;
-  vec3dd Nbc = (c-b)^n;
-  vec3dd Nca = (a-c)^n;
-  double zNab = (-a)*Nab;
-  double zNbc = (-b)*Nbc;
-  double zNca = (-c)*Nca;
-  return _samesign(zNab,zNbc,zNca);
-}
-
-static bool _zeroinhull ( const vec3dd &n, vector<vec3dd> *s )
-{
-  int i,j,k;
-  for ( int i=0; i<s->size(); i++ )
-    for ( int j=i+1; j<s->size(); j++ )
-      for ( int k=j+1; k<s->size(); k++ )
-	if (_zeroinslab (n,(*s)[i],(*s)[j],(*s)[k]))
+  *r = *l = 0;
+  for ( int i=0; i<k; i++ )
+    {
+      const vec3dd si = s[i];
+      if (si*si==0)
+	return true;
+      if (i==0)
+	continue;
+      const vec3dd sr = s[*r];
+      const vec3dd sl = s[*l];
+      double rp = _orient(n,sr,si);
+      double pl = _orient(n,si,sl);
+      if (rp>=0 && pl>=0 && (_orient(n,sr,sl)>0 || sr*si>0))
+	continue;  // inside the wedge
+      if (pl>0)
+	*r = i;
+      else 
+	if (rp>0)
+	  *l = i;
+	else
 	  return true;
+    }
   return false;
 }
 
 /* ------------------------------------------------------ */
 
-static unsigned char _testdir ( const vec3dd &tv, const vec3dd &p, vector<vec3dd> *s1, vector<vec3dd> *s2 )
+// is zero in the hull of the k vectors in s? Fewer than three vectors
+// are never considered to enclose it
+static bool _zeroinhull ( const vec3dd &n, const vec3dg *s, int k )
 {
-  unsigned char res = 0;
+  int r,l;
+  return k>=3 && _sweep(n,s,k,&r,&l);
+}
 
-  int i,j;
+/* ------------------------------------------------------ */
 
-  vec3dd o = tv^p;
+// lowest and highest x/|y| (x if y==0) among the vectors in s, projected
+// onto the plane orthogonal to p, in the coordinates (x,y) given by tv 
+// and o; index 0 is for y>0, 1 for y<0, 2 for y==0
+static void _sideratios ( const vec3dd &tv, const vec3dd &o, const vec3dd &p, 
+			  const vec3dg *s, int k, bool *has, double *lo, double *hi )
+{
+  has[0] = has[1] = has[2] = false;
+  for ( int i=0; i<k; i++ )
+    {
+      const vec3dd si = s[i];
+      vec3dd q = si-(si*p)*p;
+      double x = tv*q;
+      double y = o*q;
+      int c = y>0 ? 0 : (y<0 ? 1 : 2);
+      double t = c==2 ? x : x/fabs(y);
+      if (!has[c] || lo[c]>t)
+	lo[c] = t;
+      if (!has[c] || hi[c]<t)
+	hi[c] = t;
+      has[c] = true;
+    }
+}
 
-  // project vectors in s1 and s2...
-  vector<vec3dd> p1,p2;
-  for ( i=0; i<s1->size(); i++ )
-    p1.push_back((*s1)[i]-((*s1)[i]*p)*p);
-  for ( i=0; i<s2->size(); i++ )
-    p2.push_back((*s2)[i]-((*s2)[i]*p)*p);
+// flow along the line through the edge with direction tv: bit 0 if some
+// segment between a vector in s1 and one in s2 meets the line at or 
+// ahead of the origin, bit 1 if at or behind it; such a segment, from 
+// (x1,y1) to (x2,y2), meets it at x of the sign of x1|y2|+x2|y1|, or 
+// of x1/|y1|+x2/|y2| if neither y is zero. If both vectors are on the 
+// line, the segment covers x1..x2
+static unsigned char _testdir ( const vec3dd &tv, const vec3dd &p, 
+				const vec3dg *s1, int k1, const vec3dg *s2, int k2 )
+{
+  unsigned char res = 0;
 
-  for ( i=0; i<p1.size(); i++ )
-    {
-      double x1 = tv*p1[i];
-      double y1 = o*p1[i];
-      for ( j=0; j<p2.size(); j++ )
-	{
-	  double x2 = tv*p2[i];
-	  double y2 = o*p2[i];
-	  if (y1*y2<=0)
+  vec3dd o = tv^p;
+  bool h1[3],h2[3];
+  double lo1[3],hi1[3],lo2[3],hi2[3];
+  _sideratios(tv,o,p,s1,k1,h1,lo1,hi1);
+  _sideratios(tv,o,p,s2,k2,h2,lo2,hi2);
+
+  for ( int c1=0; c1<3; c1++ )
+    for ( int c2=0; c2<3; c2++ )
+      {
+	if (!h1[c1] || !h2[c2] || (c1==c2 && c1!=2))
+	  continue;
+	double lo,hi;
+	if (c1==2 && c2==2)
+	  {
+	    lo = min(lo1[2],lo2[2]);
+	    hi = max(hi1[2],hi2[2]);
+	  }
+	else
+	  if (c1==2)
 	    {
-	      double xis = fabs(x1)*y2+fabs(x2)*y1;
-	      if (xis>=0)
-		res |= 1;
-	      if (xis<=0)
-		res |= 2;
+	      lo = lo1[2];
+	      hi = hi1[2];
 	    }
-	}
-    }
+	  else
+	    if (c2==2)
+	      {
+		lo = lo2[2];
+		hi = hi2[2];
+	      }
+	    else
+	      {
+		lo = lo1[c1]+lo2[c2];
+		hi = hi1[c1]+hi2[c2];
+	      }
+	if (hi>=0)
+	  res |= 1;
+	if (lo<=0)
+	  res |= 2;
+      }
+
+  return res;
 }
 
 /* ------------------------------------------------------ */
 
-static void _findextreme ( const vec3dd &n, vector<vec3dd> *s, vec3dd *v, vec3dd *w )
+// extreme vectors among the k vectors in s, whose hull does not contain
+// zero: v is the clockwise-most one, w the counterclockwise-most one
+static void _findextreme ( const vec3dd &n, const vec3dg *s, int k, vec3dd *v, vec3dd *w )
 {
-  int i,j;
-  int *ctp = new int[s->size()];
-  for ( i=0; i<s->size(); i++ )
-    ctp[i] = 0;
+  int r,l;
+  _sweep(n,s,k,&r,&l);
+  *v = s[r];
+  *w = s[l];
+}
 
-  for ( i=0; i<s->size(); i++ )
-    {
-      vec3dd tv = n^(*s)[i];
-      for ( j=0; j<s->size(); j++ )
-	if (i!=j)
-	  if ((tv*(*s)[j])>=0)
-	    ++(ctp[i]);
-    }
+/* ------------------------------------------------------ */
 
-  int min,max;
-  min = max = 0;
-  int minval,maxval;
-  minval = maxval = ctp[0];
+bool pchull::iststationary ( int i )
+{
+  return fstat[i];
+}
 
-  for ( i=1; i<s->size(); i++ )
-    {
-      if (minval>ctp[i])
-	{
-	  minval = ctp[i];
-	  min = i;
-	}
-      if (maxval<ctp[i])
-	{
-	  maxval = ctp[i];
-	  max = i;
-	}
-    }
+/* ------------------------------------------------------ */
 
-  *v = (*s)[max];
-  *w = (*s)[min];
+pchull::pchull ( double wt, const char *name, char type, bool BD ) :
+  pcvf(name,type,BD), weight(wt)
+{
+  hullvectors();
+  initialize(BD);
+}
+
+/* ------------------------------------------------------ */
 
-  delete[] ctp;
+pchull::pchull ( double wt, const pcvf *base, bool BD ) :
+  pcvf(base), weight(wt)
+{
+  hullvectors();
+  initialize(BD);
 }
 
 /* ------------------------------------------------------ */
 
-bool pchull::iststationary ( int i )
+pchull::pchull ( double wt, const char *name, bool BD ) :
+  pcvf(name,'v',BD), weight(wt)
 {
-  return fstat[i];
+  F0 = new vec3dd[hulloffset(faces())];
+  Fcnt = new int[faces()];
 }
 
 /* ------------------------------------------------------ */
 
-pchull::pchull ( double wt, const char *name, char type, bool BD ) :
-  pcvf(name,type,BD), weight(wt)
+pchull::pchull ( double wt, const pcvf *base ) :
+  pcvf(base), weight(wt)
 {
-  int i,j;
+  F0 = new vec3dd[hulloffset(faces())];
+  Fcnt = new int[faces()];
+}
+
+/* ------------------------------------------------------ */
 
-  F0 = new vector<vec3dd>[faces()];
+void pchull::hullvectors()
+{
+  F0 = new vec3dd[hulloffset(faces())];
+  Fcnt = new int[faces()];
 
-  for ( i=0; i<faces(); ++i )
+  parallel_for(faces(),[&](int i, int)
     {
       mesh_element *ff = getface(i);
-      for ( j=0; j<ff->faces; j+=2 )
+      vec3dd *F0i = F0+hulloffset(i);
+      int k = 0;
+      for ( int j=0; j<ff->faces; j+=2 )
 	if (ff->face[j]->cofaces==2)
 	  {
-	    int af;  // adjacent face
-	    vec3dd ev = v[ff->face[j+1]->ID] - v[ff->face[(j+ff->faces-1)%(ff->faces)]->ID];
-	    vec3dd f0 = f[ af = ff->face[j]->coface[
-						    (ff->face[j]->coface[0]==ff) ? 1 : 0
-						    ]->ID];
-	    F0[i].push_back(f[af]-(f[af]*n[i])*n[i]);
+	    int af = ff->face[j]->coface[(ff->face[j]->coface[0]==ff) ? 1 : 0]->ID;  // adjacent face
+	    F0i[k++] = getvector(af)-(getvector(af)*normal(i))*normal(i);
 	  }
-      F0[i].push_back(f[i]);
+      F0i[k++] = getvector(i);
+      Fcnt[i] = k;
+    });
+}
 
-    }
+/* ------------------------------------------------------ */
 
-  initialize(BD);
+int pchull::hulloffset ( int i )
+{
+  return (faceoffset(i)>>1)+i;
 }
 
 /* ------------------------------------------------------ */
 
 void pchull::initialize ( bool BD )
 {
-  int i,j;
+  // now compute F, and then fstat, aflow and rflow; faces and edges
+  // are independent of each other
+  F = new vec3dg[(unsigned)hulloffset(faces())];
+  fstat = new bool[faces()];
+  switch(facedegree())
+    {
+    case 3:
+      parallel_for(faces(),[&](int i, int) { _updateflow<3>(i); });
+      break;
+    case 4:
+      parallel_for(faces(),[&](int i, int) { _updateflow<4>(i); });
+      break;
+    default:
+      parallel_for(faces(),[&](int i, int) { _updateflow<0>(i); });
+      break;
+    }
 
-  // now compute F
-  F = new vector<vec3dd>[faces()];
+  // time for eflow
+  parallel_for(edges(),[&](int i, int) { _updateeflow(i,BD); });
+    
+  // finally, the test vectors...
+  testvec1 = new vec3dd[faces()];
+  testvec2 = new vec3dd[faces()];
+  parallel_for(faces(),[&](int i, int) { _testvectors(i); });
+}
 
-  for ( i=0; i<faces(); i++ )
-    {
-      for ( j=0; j<F0[i].size(); j++ )
-	F[i].push_back(f[i]+weight*(F0[i][j]-f[i]));
+/* ------------------------------------------------------ */
 
-      for ( j=0; j<F[i].size(); j++ )
-	F[i][j] = F[i][j]-(F[i][j]*normal(i))*normal(i);
+template<int D>
+void pchull::_updateflow ( int i )
+{
+  int j;
+  const int k = Fcnt[i];
+  vec3dg *Fi = F+hulloffset(i);
+  const vec3dd *F0i = F0+hulloffset(i);
+  const vec3dd fi = getvector(i);
+  const vec3dd ni = normal(i);
+
+  for ( j=0; j<k; j++ )
+    {
+      vec3dd Fij = fi+weight*(F0i[j]-fi);
+      Fi[j] = Fij-(Fij*ni)*ni;
     }
 
-  // fstat...
-  fstat = new bool[faces()];
-  for ( i=0; i<faces(); i++ )
-    fstat[i] = _zeroinhull(normal(i),&F[i]);
+  fstat[i] = _zeroinhull(normal(i),Fi,k);
 
-  // update aflow and rflow 
-  for ( i=0; i<faces(); i++ )
+  mesh_element *ff = getface(i);
+  const int m = D ? 2*D : ff->faces;  // number of boundary elements
+  unsigned short a = aflow[i];
+  unsigned short r = rflow[i];
+  for ( j=0; j<m; j+=2 )
     {
-      mesh_element *ff = getface(i);
-      for ( j=0; j<ff->faces; j+=2 )
-	{
-	  vec3dd ev = v[ff->face[j+1]->ID] - v[ff->face[(j+ff->faces-1)%(ff->faces)]->ID];
-	  vec3dd ei = n[i]^ev;
-	  double tst = ei*(v[ff->face[(j+3)%ff->faces]->ID]-v[ff->face[j+1]->ID]);
-	  assert(tst!=0);
-	  if (tst<0)
-	    ei = -ei;
-	  ei.normalize();
-	  aflow[i][j] |= fstat[i] || _dotnegative(ei,&F[i]);
-	  rflow[i][j] |= fstat[i] || _dotpositive(ei,&F[i]);
-	}
-      aflow[i][ff->faces-1] = aflow[i][ff->faces-2] && aflow[i][0];
-      rflow[i][ff->faces-1] = rflow[i][ff->faces-2] && rflow[i][0];
-      for ( j=1; j<ff->faces-2; j+=2 )
-	{
-	  aflow[i][j] = aflow[i][j-1] && aflow[i][j+1];
-	  rflow[i][j] = rflow[i][j-1] && rflow[i][j+1];
-	}      
+      vec3dd ev = vertex(ff->face[j+1]->ID) - vertex(ff->face[(j+m-1)%m]->ID);
+      vec3dd ei = normal(i)^ev;
+      double tst = ei*(vertex(ff->face[(j+3)%m]->ID)-vertex(ff->face[j+1]->ID));
+      assert(tst!=0);
+      if (tst<0)
+	ei = -ei;
+      ei.normalize();
+      if (fstat[i] || _dotnegative(ei,Fi,k))
+	a |= 1<<j;
+      if (fstat[i] || _dotpositive(ei,Fi,k))
+	r |= 1<<j;
     }
+  aflow[i] = _vertexbits(a,m);
+  rflow[i] = _vertexbits(r,m);
+}
 
+/* ------------------------------------------------------ */
 
-  // time for eflow
-  for ( i=0; i<edges(); i++ )
+void pchull::_updateeflow ( int i, bool BD )
+{
+  mesh_element *ee = mesh::getedge(i);
+  vec3dd evc = vertex(ee->face[1]->ID)-vertex(ee->face[0]->ID);
+  evc.normalize();
+  switch(ee->cofaces)
     {
-      mesh_element *ee = mesh::getedge(i);
-      vec3dd evc = v[ee->face[1]->ID]-v[ee->face[0]->ID];
-      evc.normalize();
-      switch(ee->cofaces)
-	{
-	case 1:
+    case 1:
+      {
+	// boundary edge 
+	if (BD)
 	  {
-	    // boundary edge 
-	    if (BD)
-	      {
-		if (_dotpositive(evc,&F[ee->coface[0]->ID]) || fstat[ee->coface[0]->ID])
-		  eflow[i] |= 1;
-		if (_dotnegative(evc,&F[ee->coface[0]->ID]) || fstat[ee->coface[0]->ID])
-		  eflow[i] |= 2;
-	      }
+	    int c = ee->coface[0]->ID;
+	    if (_dotpositive(evc,F+hulloffset(c),Fcnt[c]) || fstat[c])
+	      eflow[i] |= 1;
+	    if (_dotnegative(evc,F+hulloffset(c),Fcnt[c]) || fstat[c])
+	      eflow[i] |= 2;
 	  }
-	  break;
+      }
+      break;
 
-	case 2:
+    case 2:
+      {
+	if (fstat[ee->coface[0]->ID] || fstat[ee->coface[1]->ID])
 	  {
-	    if (fstat[ee->coface[0]->ID] || fstat[ee->coface[1]->ID])
-	      {
-		eflow[i] |= 3;
-		continue;
-	      }
-	    vec3dd an = n[ee->coface[1]->ID]+n[ee->coface[0]->ID];
-	    vec3dd ev = v[ee->face[1]->ID] - v[ee->face[0]->ID];
-	    an.normalize();
-	    eflow[i] |=  _testdir(ev,an,&F[ee->coface[0]->ID],&F[ee->coface[1]->ID]);
+	    eflow[i] |= 3;
+	    return;
 	  }
-	  break;
-
-	default:
-	  assert(0);
-	  break;
-	}
+	vec3dd an = normal(ee->coface[1]->ID)+normal(ee->coface[0]->ID);
+	vec3dd ev = vertex(ee->face[1]->ID) - vertex(ee->face[0]->ID);
+	an.normalize();
+	int c0 = ee->coface[0]->ID;
+	int c1 = ee->coface[1]->ID;
+	eflow[i] |=  _testdir(ev,an,F+hulloffset(c0),Fcnt[c0],F+hulloffset(c1),Fcnt[c1]);
+      }
+      break;
+
+    default:
+      assert(0);
+      break;
     }
-    
-  // finally, the test vectors...
-  testvec1 = new vec3dd[faces()];
-  testvec2 = new vec3dd[faces()];
-  
-  for ( i=0; i<faces(); i++ )
-    {
-      if (fstat[i])
-	continue;
+}
 
-      vec3dd tv1;
-      vec3dd tv2;
-      _findextreme(n[i],&F[i],&tv1,&tv2);
-      vec3dd tst1 = tv1^n[i];
-      vec3dd tst2 = tv2^n[i];
-      if (tst1*tv2>0) 
-	tst1 = -tst1;
-      if (tst2*tv1>0)
-	tst2 = -tst2;
-      testvec1[i] = tst1;
-      testvec2[i] = tst2;
-    }
+/* ------------------------------------------------------ */
+
+void pchull::_testvectors ( int i )
+{
+  if (fstat[i])
+    return;
+
+  vec3dd tv1;
+  vec3dd tv2;
+  _findextreme(normal(i),F+hulloffset(i),Fcnt[i],&tv1,&tv2);
+  vec3dd tst1 = tv1^normal(i);
+  vec3dd tst2 = tv2^normal(i);
+  if (tst1*tv2>0) 
+    tst1 = -tst1;
+  if (tst2*tv1>0)
+    tst2 = -tst2;
+  testvec1[i] = tst1;
+  testvec2[i] = tst2;
 }
 
 /* ------------------------------------------------------ */
@@ -315,9 +409,12 @@ bool pchull::connects ( int fce, int eix1, int eix2,
   if (fstat[fce])
     return false;
 
+  const vec3dg *pv = fv+(faceoffset(fce)>>1);  // vertices of fce
+  const vec3dg *pe = fe+faceoffset(fce);       // endpoints of its edges
+
   if ( (eix1&1) && (eix2&1) )
     {
-      vec3dd w = v[getface(fce)->face[eix2]->ID]-v[getface(fce)->face[eix1]->ID];
+      vec3dd w = vec3dd(pv[eix2>>1])-vec3dd(pv[eix1>>1]);
       res = (w*testvec1[fce]<=0) && (w*testvec2[fce]<=0);
     }
 
@@ -325,9 +422,9 @@ bool pchull::connects ( int fce, int eix1, int eix2,
     {
       // vertex and edge piece
 
-      vec3dd e2s = edgepoint(getface(fce)->face[eix2]->ID,s2);
-      vec3dd e2e = edgepoint(getface(fce)->face[eix2]->ID,e2);
-      vec3dd p1 = v[getface(fce)->face[eix1]->ID];
+      vec3dd e2s = (1-s2)*vec3dd(pe[eix2])+s2*vec3dd(pe[eix2+1]);
+      vec3dd e2e = (1-e2)*vec3dd(pe[eix2])+e2*vec3dd(pe[eix2+1]);
+      vec3dd p1 = pv[eix1>>1];
       vec3dd v1 = e2s-p1;
       vec3dd v2 = e2e-p1;
       
@@ -342,9 +439,9 @@ bool pchull::connects ( int fce, int eix1, int eix2,
     {
       // vertex and edge piece
 
-      vec3dd e1s = edgepoint(getface(fce)->face[eix1]->ID,s1);
-      vec3dd e1e = edgepoint(getface(fce)->face[eix1]->ID,e1);
-      vec3dd p2 = v[getface(fce)->face[eix2]->ID];
+      vec3dd e1s = (1-s1)*vec3dd(pe[eix1])+s1*vec3dd(pe[eix1+1]);
+      vec3dd e1e = (1-e1)*vec3dd(pe[eix1])+e1*vec3dd(pe[eix1+1]);
+      vec3dd p2 = pv[eix2>>1];
       vec3dd v1 = p2-e1s;
       vec3dd v2 = p2-e1e;
       
@@ -358,10 +455,10 @@ bool pchull::connects ( int fce, int eix1, int eix2,
   if ( !(eix1&1) && !(eix2&1) )
     {
       // both edges
-      vec3dd e2s = edgepoint(getface(fce)->face[eix2]->ID,s2);
-      vec3dd e2e = edgepoint(getface(fce)->face[eix2]->ID,e2);
-      vec3dd e1s = edgepoint(getface(fce)->face[eix1]->ID,s1);
-      vec3dd e1e = edgepoint(getface(fce)->face[eix1]->ID,e1);
+      vec3dd e2s = (1-s2)*vec3dd(pe[eix2])+s2*vec3dd(pe[eix2+1]);
+      vec3dd e2e = (1-e2)*vec3dd(pe[eix2])+e2*vec3dd(pe[eix2+1]);
+      vec3dd e1s = (1-s1)*vec3dd(pe[eix1])+s1*vec3dd(pe[eix1+1]);
+      vec3dd e1e = (1-e1)*vec3dd(pe[eix1])+e1*vec3dd(pe[eix1+1]);
       vec3dd v1 = e2s-e1s;
       vec3dd v2 = e2s-e1e;
       vec3dd v3 = e2e-e1s;
@@ -381,6 +478,31 @@ bool pchull::connects ( int fce, int eix1, int eix2,
 
 /* ------------------------------------------------------ */
 
+void pchull::connects_batch ( int cnt, const cquery *q, unsigned char *res )
+{
+  for ( int k=0; k<cnt; k++ )
+    res[k] = pchull::connects(q[k].fce,q[k].eix1,q[k].eix2,q[k].s1,q[k].e1,q[k].s2,q[k].e2);
+}
+
+/* ------------------------------------------------------ */
+
+void pchull::spread_changes ( bool *changed )
+{
+  vector<int> cf;
+  for ( int i=0; i<faces(); i++ )
+    if (changed[i])
+      cf.push_back(i);
+  for ( int i=0; i<cf.size(); i++ )
+    {
+      mesh_element *ff = getface(cf[i]);
+      for ( int j=0; j<ff->faces; j+=2 )
+	for ( int k=0; k<ff->face[j]->cofaces; k++ )
+	  changed[ff->face[j]->coface[k]->ID] = true;
+    }
+}
+
+/* ------------------------------------------------------ */
+
 pchull::~pchull()
 {
   if (fstat) delete[] fstat;
@@ -388,8 +510,10 @@ pchull::~pchull()
   if (testvec2) delete[] testvec2;
   if (F0) delete[] F0;
   if (F) delete[] F;
+  if (Fcnt) delete[] Fcnt;
   F = NULL;
   F0 = NULL;
+  Fcnt = NULL;
   fstat = NULL;
   testvec1 = testvec2 = NULL;
 }
@@ -38,9 +38,9 @@ class pchull : public pcvf
   // the vector field is actually f+weight*(F-f)
   double weight;
 
-  // vector field assigns hull of F=f(i)+weight*(F0(i)-f(i)) to face i
-  std::vector<vec3dd> *F;
-  
+  // vector field assigns hull of F=f(i)+weight*(F0(i)-f(i)) to face i;
+  // the Fcnt[i] vectors of face i start at F+hulloffset(i)
+  vec3dg *F;
 
   bool *fstat;  // stationary faces...
 
@@ -48,16 +48,37 @@ class pchull : public pcvf
   vec3dd *testvec1;
   vec3dd *testvec2;
 
+  // per-element parts of initialize(), run in parallel; D as in pcvf
+  template<int D> void _updateflow ( int i );   // F, fstat, aflow, rflow of face i
+  void _updateeflow ( int i, bool BD );   // eflow of edge i
+  void _testvectors ( int i );   // testvec1, testvec2 of face i
+
  protected:
 
-  std::vector<vec3dd> *F0;
+  // F0 has the same layout as F; derived classes fill F0 and Fcnt 
+  // before calling initialize()
+  vec3dd *F0;
+  int *Fcnt;
   void initialize( bool BD );
 
+  // offset of the vectors of face i in F and F0; leaves room for one 
+  // vector per vertex of the face and one more
+  int hulloffset ( int i );
+
+  // set up a field with no F0 yet, from a (vertex-based) file or base; 
+  // used by pcenv
+  pchull ( double wt, const char *name, bool BD );
+  pchull ( double wt, const pcvf *base );
+
+  void hullvectors();   // F0 and Fcnt of pchull
+
  public:
 
   virtual bool iststationary ( int i );
     
   pchull ( double wt, const char *name, char type = 'f', bool BD = true );
+  // same for the field base was read from (see pcvf ( const pcvf *base ))
+  pchull ( double wt, const pcvf *base, bool BD );
 
   virtual ~pchull();
 
@@ -65,6 +86,11 @@ class pchull : public pcvf
   virtual bool connects ( int fce, int eix1, int eix2, 
 			  double s1 = 0, double e1 = 1, 
 			  double s2 = 0, double e2 = 1 );
+  // connects() above for each query; pcvf's version does not apply here
+  virtual void connects_batch ( int cnt, const cquery *q, unsigned char *res );
+
+  // the hull of a face includes the vectors of the faces across its edges
+  virtual void spread_changes ( bool *changed );
   
 };
 
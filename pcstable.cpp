@@ -25,6 +25,7 @@
 */
 
 #include <pcstable.h>
+#include <parallel.h>
 
 #define EPS 1e-8
 
@@ -40,187 +41,227 @@ bool pcstable::iststationary ( int i )
 pcstable::pcstable ( double stability, const char *name, char type, bool BD ) :
   pcvf(name,type,BD), R(stability)
 {
-  int i,j;
+  initialize(BD);
+}
+
+/* ------------------------------------------------------ */
+
+pcstable::pcstable ( double stability, const pcvf *base, bool BD ) :
+  pcvf(base), R(stability)
+{
+  initialize(BD);
+}
+
+/* ------------------------------------------------------ */
 
+void pcstable::initialize ( bool BD )
+{
   fstat = new bool[faces()];
-  for ( i=0; i<faces(); i++ )
-    fstat[i] = (f[i].norm()<=R);
+  parallel_for(faces(),[&](int i, int) { fstat[i] = (getvector(i).norm()<=R); });
 
-  // we need to update aflow, rflow, eflow
+  // we need to update aflow, rflow, eflow; each face (edge) depends only
+  // on its own data and that of its cofaces
 
   // aflow and rflow first
-  for ( i=0; i<faces(); i++ )
+  switch(facedegree())
     {
-      mesh_element *ff = getface(i);
-      for ( j=0; j<ff->faces; j+=2 )
-	{
-	  vec3dd ev = v[ff->face[j+1]->ID] - v[ff->face[(j+ff->faces-1)%(ff->faces)]->ID];
-	  vec3dd ei = n[i]^ev;
-	  double tst = ei*(v[ff->face[(j+3)%ff->faces]->ID]-v[ff->face[j+1]->ID]);
-	  assert(tst!=0);
-	  if (tst<0)
-	    ei = -ei;
-	  ei.normalize();
-	  aflow[i][j] |= fstat[i] || (ei*f[i]<=R);
-	  rflow[i][j] |= fstat[i] || (ei*f[i]>=-R);
-	}
-      aflow[i][ff->faces-1] = aflow[i][ff->faces-2] && aflow[i][0];
-      rflow[i][ff->faces-1] = rflow[i][ff->faces-2] && rflow[i][0];
-      for ( j=1; j<ff->faces-2; j+=2 )
-	{
-	  aflow[i][j] = aflow[i][j-1] && aflow[i][j+1];
-	  rflow[i][j] = rflow[i][j-1] && rflow[i][j+1];
-	}      
+    case 3:
+      parallel_for(faces(),[&](int i, int) { _updateflow<3>(i); });
+      break;
+    case 4:
+      parallel_for(faces(),[&](int i, int) { _updateflow<4>(i); });
+      break;
+    default:
+      parallel_for(faces(),[&](int i, int) { _updateflow<0>(i); });
+      break;
     }
 
   // time for eflow
-  for ( i=0; i<edges(); i++ )
+  parallel_for(edges(),[&](int i, int) { _updateeflow(i,BD); });
+  
+  testvec1 = new vec3dd[faces()];
+  testvec2 = new vec3dd[faces()];
+  parallel_for(faces(),[&](int i, int) { _testvectors(i); });
+}
+
+/* ------------------------------------------------------ */
+
+template<int D>
+void pcstable::_updateflow ( int i )
+{
+  int j;
+
+  mesh_element *ff = getface(i);
+  const int m = D ? 2*D : ff->faces;  // number of boundary elements
+  unsigned short a = aflow[i];
+  unsigned short r = rflow[i];
+  for ( j=0; j<m; j+=2 )
     {
-      mesh_element *ee = mesh::getedge(i);
-      vec3dd evc = v[ee->face[1]->ID]-v[ee->face[0]->ID];
-      evc.normalize();
-      switch(ee->cofaces)
-	{
-	case 1:
+      vec3dd ev = vertex(ff->face[j+1]->ID) - vertex(ff->face[(j+m-1)%m]->ID);
+      vec3dd ei = normal(i)^ev;
+      double tst = ei*(vertex(ff->face[(j+3)%m]->ID)-vertex(ff->face[j+1]->ID));
+      assert(tst!=0);
+      if (tst<0)
+	ei = -ei;
+      ei.normalize();
+      if (fstat[i] || (ei*getvector(i)<=R))
+	a |= 1<<j;
+      if (fstat[i] || (ei*getvector(i)>=-R))
+	r |= 1<<j;
+    }
+  aflow[i] = _vertexbits(a,m);
+  rflow[i] = _vertexbits(r,m);
+}
+
+/* ------------------------------------------------------ */
+
+void pcstable::_updateeflow ( int i, bool BD )
+{
+  mesh_element *ee = mesh::getedge(i);
+  vec3dd evc = vertex(ee->face[1]->ID)-vertex(ee->face[0]->ID);
+  evc.normalize();
+  switch(ee->cofaces)
+    {
+    case 1:
+      {
+	// boundary edge 
+	if (BD)
 	  {
-	    // boundary edge 
-	    if (BD)
-	      {
-		if (evc*f[ee->coface[0]->ID]>=-R || fstat[ee->coface[0]->ID])
-		  eflow[i] |= 1;
-		if (evc*f[ee->coface[0]->ID]<= R || fstat[ee->coface[0]->ID])
-		  eflow[i] |= 2;
-	      }
+	    if (evc*getvector(ee->coface[0]->ID)>=-R || fstat[ee->coface[0]->ID])
+	      eflow[i] |= 1;
+	    if (evc*getvector(ee->coface[0]->ID)<= R || fstat[ee->coface[0]->ID])
+	      eflow[i] |= 2;
 	  }
-	  break;
+      }
+      break;
 
-	case 2:
+    case 2:
+      {
+	if (fstat[ee->coface[0]->ID] || fstat[ee->coface[1]->ID])
+	  {
+	    eflow[i] |= 3;
+	    return;
+	  }
+	vec3dd an = normal(ee->coface[1]->ID)+normal(ee->coface[0]->ID);
+	double shrink = an.norm()/2;
+	an.normalize();
+	vec3dd f1 = getvector(ee->coface[0]->ID)-(getvector(ee->coface[0]->ID)*an)*an;
+	vec3dd f2 = getvector(ee->coface[1]->ID)-(getvector(ee->coface[1]->ID)*an)*an;
+	vec3dd ev = vertex(ee->face[1]->ID) - vertex(ee->face[0]->ID);
+	ev.normalize();
+	vec3dd pp = ev^an;
+	double x2 = f2*ev;
+	double x1 = f1*ev;
+	double y2 = (f2*pp)/shrink;
+	double y1 = (f1*pp)/shrink;
+
+	int ct = 0;
+
+	if (fabs(y1)<=R)
 	  {
-	    if (fstat[ee->coface[0]->ID] || fstat[ee->coface[1]->ID])
-	      {
-		eflow[i] |= 3;
-		continue;
-	      }
-	    vec3dd an = n[ee->coface[1]->ID]+n[ee->coface[0]->ID];
-	    double shrink = an.norm()/2;
-	    an.normalize();
-	    vec3dd f1 = f[ee->coface[0]->ID]-(f[ee->coface[0]->ID]*an)*an;
-	    vec3dd f2 = f[ee->coface[1]->ID]-(f[ee->coface[1]->ID]*an)*an;
-	    vec3dd ev = v[ee->face[1]->ID] - v[ee->face[0]->ID];
-	    ev.normalize();
-	    vec3dd pp = ev^an;
-	    double x2 = f2*ev;
-	    double x1 = f1*ev;
-	    double y2 = (f2*pp)/shrink;
-	    double y1 = (f1*pp)/shrink;
-	    
-	    int ct = 0;
-
-	    if (fabs(y1)<=R)
-	      {
-		double delta = sqrt(R*R-y1*y1);
-		if (x1-delta<=0) 
-		  eflow[i] |= 2;
-		if (x1+delta>=0)
-		  eflow[i] |= 1;
-		ct++;
-	      }
-
-	    if (fabs(y2)<=R)
-	      {
-		double delta = sqrt(R*R-y2*y2);
-		if (x2-delta<=0) 
-		  eflow[i] |= 2;
-		if (x2+delta>=0)
-		  eflow[i] |= 1;
-		ct++;
-	      }
-
-	    if (ct==2) continue;
-
-	    if (ct==0 && y1*y2>0)
-	      continue;
-
-	    double x12 = x2-x1;
-	    double y12 = y2-y1;
-
-	    double px = -y12;
-	    double py = x12;
-	    double nm = sqrt(y12*y12+x12*x12);
-	    if (nm==0) continue;
-
-	    px *= R/nm;
-	    py *= R/nm;
-
-	    double a1 = x1+px;
-	    double b1 = y1+py;
-	    double c1 = x2+px;
-	    double d1 = y2+py;
-
-	    double a2 = x1-px;
-	    double b2 = y1-py;
-	    double c2 = x2-px;
-	    double d2 = y2-py;
-
-	    // check for intersections of intervals a1b1--c1d1 and a2b2--c2d2
-	    // with the x-axis
-
-	    if (b1*d1<0)
-	      {
-		double xis = fabs(b1)*c1+fabs(d1)*a1;
-		if (xis<=0) 
-		  eflow[i] |= 2;
-		if (xis>=0)
-		  eflow[i] |= 1;
-	      }
-
-	    if (b2*d2<0)
-	      {
-		double xis = fabs(b2)*c2+fabs(d2)*a2;
-		if (xis<=0) 
-		  eflow[i] |= 2;
-		if (xis>=0)
-		  eflow[i] |= 1;
-	      }
+	    double delta = sqrt(R*R-y1*y1);
+	    if (x1-delta<=0) 
+	      eflow[i] |= 2;
+	    if (x1+delta>=0)
+	      eflow[i] |= 1;
+	    ct++;
 	  }
-	  break;
 
-	default:
-	  assert(0);
-	  break;
-	}
-    }
-  
-  testvec1 = new vec3dd[faces()];
-  testvec2 = new vec3dd[faces()];
-  
-  for ( i=0; i<faces(); i++ )
-    {
-      if (fstat[i])
-	continue;
-      double sinalpha = R/f[i].norm();
-      if (sinalpha>1) sinalpha = 1;
-      double cosalpha = sqrt(1-sinalpha*sinalpha);
-      if (cosalpha<EPS) cosalpha = EPS;
-      double tanalpha = sinalpha/cosalpha;
-      vec3dd tv1 = f[i]+(/*sinalpha**/tanalpha)*(n[i]^f[i]);
-      vec3dd tv2 = f[i]-(/*sinalpha**/tanalpha)*(n[i]^f[i]);
-      vec3dd tst1 = tv1^n[i];
-      vec3dd tst2 = tv2^n[i];
-      if (tst1*tv2>0) 
-	tst1 = -tst1;
-      if (tst2*tv1>0)
-	tst2 = -tst2;
-      testvec1[i] = tst1;
-      testvec2[i] = tst2;
-
-      //      cout << f[i] << " " << n[i] << " / " << tv1 << " " << tv2 << " / " << testvec1[i] << " " << testvec2[i] << 
-      //	sinalpha << " " << cosalpha << " " << tanalpha << endl;
+	if (fabs(y2)<=R)
+	  {
+	    double delta = sqrt(R*R-y2*y2);
+	    if (x2-delta<=0) 
+	      eflow[i] |= 2;
+	    if (x2+delta>=0)
+	      eflow[i] |= 1;
+	    ct++;
+	  }
+
+	if (ct==2) return;
+
+	if (ct==0 && y1*y2>0)
+	  return;
+
+	double x12 = x2-x1;
+	double y12 = y2-y1;
+
+	double px = -y12;
+	double py = x12;
+	double nm = sqrt(y12*y12+x12*x12);
+	if (nm==0) return;
+
+	px *= R/nm;
+	py *= R/nm;
+
+	double a1 = x1+px;
+	double b1 = y1+py;
+	double c1 = x2+px;
+	double d1 = y2+py;
+
+	double a2 = x1-px;
+	double b2 = y1-py;
+	double c2 = x2-px;
+	double d2 = y2-py;
+
+	// check for intersections of intervals a1b1--c1d1 and a2b2--c2d2
+	// with the x-axis
+
+	if (b1*d1<0)
+	  {
+	    double xis = fabs(b1)*c1+fabs(d1)*a1;
+	    if (xis<=0) 
+	      eflow[i] |= 2;
+	    if (xis>=0)
+	      eflow[i] |= 1;
+	  }
+
+	if (b2*d2<0)
+	  {
+	    double xis = fabs(b2)*c2+fabs(d2)*a2;
+	    if (xis<=0) 
+	      eflow[i] |= 2;
+	    if (xis>=0)
+	      eflow[i] |= 1;
+	  }
+      }
+      break;
+
+    default:
+      assert(0);
+      break;
     }
 }
 
 /* ------------------------------------------------------ */
 
+void pcstable::_testvectors ( int i )
+{
+  if (fstat[i])
+    return;
+  vec3dd fi = getvector(i);
+  vec3dd ni = normal(i);
+  double sinalpha = R/fi.norm();
+  if (sinalpha>1) sinalpha = 1;
+  double cosalpha = sqrt(1-sinalpha*sinalpha);
+  if (cosalpha<EPS) cosalpha = EPS;
+  double tanalpha = sinalpha/cosalpha;
+  vec3dd tv1 = fi+(/*sinalpha**/tanalpha)*(ni^fi);
+  vec3dd tv2 = fi-(/*sinalpha**/tanalpha)*(ni^fi);
+  vec3dd tst1 = tv1^ni;
+  vec3dd tst2 = tv2^ni;
+  if (tst1*tv2>0) 
+    tst1 = -tst1;
+  if (tst2*tv1>0)
+    tst2 = -tst2;
+  testvec1[i] = tst1;
+  testvec2[i] = tst2;
+
+  //      cout << f[i] << " " << n[i] << " / " << tv1 << " " << tv2 << " / " << testvec1[i] << " " << testvec2[i] << 
+  //	sinalpha << " " << cosalpha << " " << tanalpha << endl;
+}
+
+/* ------------------------------------------------------ */
+
 bool pcstable::connects ( int fce, int eix1, int eix2, 
 				  double s1, double e1, 
 				  double s2, double e2 )
@@ -231,9 +272,12 @@ bool pcstable::connects ( int fce, int eix1, int eix2,
   if (fstat[fce])
     return false;
 
+  const vec3dg *pv = fv+(faceoffset(fce)>>1);  // vertices of fce
+  const vec3dg *pe = fe+faceoffset(fce);       // endpoints of its edges
+
   if ( (eix1&1) && (eix2&1) )
     {
-      vec3dd w = v[getface(fce)->face[eix2]->ID]-v[getface(fce)->face[eix1]->ID];
+      vec3dd w = vec3dd(pv[eix2>>1])-vec3dd(pv[eix1>>1]);
       res = (w*testvec1[fce]<=0) && (w*testvec2[fce]<=0);
     }
 
@@ -241,9 +285,9 @@ bool pcstable::connects ( int fce, int eix1, int eix2,
     {
       // vertex and edge piece
 
-      vec3dd e2s = edgepoint(getface(fce)->face[eix2]->ID,s2);
-      vec3dd e2e = edgepoint(getface(fce)->face[eix2]->ID,e2);
-      vec3dd p1 = v[getface(fce)->face[eix1]->ID];
+      vec3dd e2s = (1-s2)*vec3dd(pe[eix2])+s2*vec3dd(pe[eix2+1]);
+      vec3dd e2e = (1-e2)*vec3dd(pe[eix2])+e2*vec3dd(pe[eix2+1]);
+      vec3dd p1 = pv[eix1>>1];
       vec3dd v1 = e2s-p1;
       vec3dd v2 = e2e-p1;
       
@@ -258,9 +302,9 @@ bool pcstable::connects ( int fce, int eix1, int eix2,
     {
       // vertex and edge piece
 
-      vec3dd e1s = edgepoint(getface(fce)->face[eix1]->ID,s1);
-      vec3dd e1e = edgepoint(getface(fce)->face[eix1]->ID,e1);
-      vec3dd p2 = v[getface(fce)->face[eix2]->ID];
+      vec3dd e1s = (1-s1)*vec3dd(pe[eix1])+s1*vec3dd(pe[eix1+1]);
+      vec3dd e1e = (1-e1)*vec3dd(pe[eix1])+e1*vec3dd(pe[eix1+1]);
+      vec3dd p2 = pv[eix2>>1];
       vec3dd v1 = p2-e1s;
       vec3dd v2 = p2-e1e;
       
@@ -274,10 +318,10 @@ bool pcstable::connects ( int fce, int eix1, int eix2,
   if ( !(eix1&1) && !(eix2&1) )
     {
       // both edges
-      vec3dd e2s = edgepoint(getface(fce)->face[eix2]->ID,s2);
-      vec3dd e2e = edgepoint(getface(fce)->face[eix2]->ID,e2);
-      vec3dd e1s = edgepoint(getface(fce)->face[eix1]->ID,s1);
-      vec3dd e1e = edgepoint(getface(fce)->face[eix1]->ID,e1);
+      vec3dd e2s = (1-s2)*vec3dd(pe[eix2])+s2*vec3dd(pe[eix2+1]);
+      vec3dd e2e = (1-e2)*vec3dd(pe[eix2])+e2*vec3dd(pe[eix2+1]);
+      vec3dd e1s = (1-s1)*vec3dd(pe[eix1])+s1*vec3dd(pe[eix1+1]);
+      vec3dd e1e = (1-e1)*vec3dd(pe[eix1])+e1*vec3dd(pe[eix1+1]);
       vec3dd v1 = e2s-e1s;
       vec3dd v2 = e2s-e1e;
       vec3dd v3 = e2e-e1s;
@@ -297,6 +341,14 @@ bool pcstable::connects ( int fce, int eix1, int eix2,
 
 /* ------------------------------------------------------ */
 
+void pcstable::connects_batch ( int cnt, const cquery *q, unsigned char *res )
+{
+  for ( int k=0; k<cnt; k++ )
+    res[k] = pcstable::connects(q[k].fce,q[k].eix1,q[k].eix2,q[k].s1,q[k].e1,q[k].s2,q[k].e2);
+}
+
+/* ------------------------------------------------------ */
+
 pcstable::~pcstable()
 {
   if (fstat) delete[] fstat;
@@ -41,17 +41,27 @@ class pcstable : public pcvf
   vec3dd *testvec1;
   vec3dd *testvec2;
 
+  // per-element parts of the constructor, run in parallel; D as in pcvf
+  template<int D> void _updateflow ( int i );   // aflow, rflow of face i
+  void _updateeflow ( int i, bool BD );   // eflow of edge i
+  void _testvectors ( int i );   // testvec1, testvec2 of face i
+  void initialize ( bool BD );   // all of the above
+
  public:
 
   virtual bool iststationary ( int i );
   
   pcstable ( double stability, const char *name, char type = 'f', bool BD=true );
+  // same for the field base was read from (see pcvf ( const pcvf *base ))
+  pcstable ( double stability, const pcvf *base, bool BD );
   virtual ~pcstable();
 
   // are two edges connected by flow through the face?
   virtual bool connects ( int fce, int eix1, int eix2, 
 			  double s1 = 0, double e1 = 1, 
 			  double s2 = 0, double e2 = 1 );
+  // connects() above for each query; pcvf's version does not apply here
+  virtual void connects_batch ( int cnt, const cquery *q, unsigned char *res );
   
 };
 
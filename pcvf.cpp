@@ -26,6 +26,14 @@
 #include <cstdlib>
 #include <pcvf.h>
 #include <iostream>
+#include <parallel.h>
+#include <binfile.h>
+#include <algorithm>
+#include <vector>
+#include <cstddef>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -34,42 +42,93 @@ using namespace std;
 pcvf::pcvf ( const char *name, char type, bool BD ) :
   vfield_base(name), pvf(NULL)
 {
-  int i;
+  _read(ifs,bin,name,type);
+  if (bin)
+    {
+      // everything in the mapped input has been read
+      delete bin;
+      bin = NULL;
+    }
+  _compute(BD);
+}
 
-  f = new vec3dd[faces()];
+/* ------------------------------------------------------ */
 
-  if (type=='f')
+pcvf::pcvf ( const pcvf *m, const char *name, char type, bool BD ) :
+  vfield_base(m), pvf(NULL)
+{
+  ifstream is(name);
+  if (!is)
     {
-      for ( i=0; i<faces(); i++ )
-	{
-	  ifs >> f[i][0] >> f[i][1] >> f[i][2];   
+      cout << "Can't open " << name << endl;
+      exit(1);
+    }
+  _read(is,NULL,name,type);
+  _compute(BD);
+}
 
-	  if (ifs.eof())
-	    {
-	      cout << "Premature end of file: " << name << endl;
-	      exit(1);
-	    }
-	}
+/* ------------------------------------------------------ */
+
+// the first cnt vectors of the binary input b into dst
+
+static void _readbinary ( binfile *b, const char *name, int cnt, vec3dg *dst )
+{
+  if (b->h.vectors<cnt)
+    {
+      cout << "Premature end of file: " << name << endl;
+      exit(1);
     }
-  else
-    if (type=='v')
-      {
-	pvf = new vec3dd[vertices()];
-	for ( i=0; i<vertices(); ++i )
+  parallel_for(cnt,[&](int i, int) { dst[i] = b->vector(i); });
+}
+
+/* ------------------------------------------------------ */
+
+void pcvf::_read ( istream &is, binfile *b, const char *name, char type )
+{
+  int i;
+
+  f = new vec3dg[(unsigned)faces()];
+
+  if (type=='f')
+    {
+      if (b)
+	_readbinary(b,name,faces(),f);
+      else
+	for ( i=0; i<faces(); i++ )
 	  {
-	    ifs >> pvf[i][0] >> pvf[i][1] >> pvf[i][2];
-	    if (ifs.eof())
+	    is >> f[i][0] >> f[i][1] >> f[i][2];   
+
+	    if (is.eof())
 	      {
 		cout << "Premature end of file: " << name << endl;
 		exit(1);
 	      }
 	  }
+    }
+  else
+    if (type=='v')
+      {
+	pvf = new vec3dg[(unsigned)vertices()];
+	if (b)
+	  _readbinary(b,name,vertices(),pvf);
+	else
+	  for ( i=0; i<vertices(); ++i )
+	    {
+	      is >> pvf[i][0] >> pvf[i][1] >> pvf[i][2];
+	      if (is.eof())
+		{
+		  cout << "Premature end of file: " << name << endl;
+		  exit(1);
+		}
+	    }
 
 	for ( i=0; i<faces(); ++i )
 	  {
+	    vec3dd fi(0,0,0);
 	    for ( int j=1; j<getface(i)->faces; j+=2 )
-	      f[i] += pvf[getface(i)->face[j]->ID];
-	    f[i] *= (2.0/getface(i)->faces);
+	      fi += pvf[getface(i)->face[j]->ID];
+	    fi *= (2.0/getface(i)->faces);
+	    f[i] = fi;
 	  }
       }
     else
@@ -77,375 +136,662 @@ pcvf::pcvf ( const char *name, char type, bool BD ) :
 	cout << "Unknown type in pcvf::pcvf" << endl;
 	exit(1);
       }
+}
+
+/* ------------------------------------------------------ */
+
+void pcvf::_compute ( bool BD )
+{
+  int i;
 
   // project to face
+  project_out(faces(),f,n);
+
   for ( i=0; i<faces(); i++ )
-    f[i] -= (f[i]*n[i])*n[i];
+    if (getface(i)->faces>16)
+      {
+	cout << "Face " << i << " has more than 8 edges; this is not supported" << endl;
+	exit(1);
+      }
   
   // fill aflow...
-  aflow = new bool*[faces()];
-  rflow = new bool*[faces()];
+  aflow = new unsigned short[faces()];
+  rflow = new unsigned short[faces()];
+
+  // the faces are independent of each other, and so are the edges, 
+  // the projections and the vertices below; perturbations are 
+  // reported after the loop, in face order
+  vec3dd *f0 = new vec3dd[faces()];
+  bool *perturbed = new bool[faces()];
+  for ( i=0; i<faces(); i++ )
+    f0[i] = f[i];
+  switch(facedegree())
+    {
+    case 3:
+      parallel_for(faces(),[&](int i, int) { perturbed[i] = _faceflow<3>(i); });
+      break;
+    case 4:
+      parallel_for(faces(),[&](int i, int) { perturbed[i] = _faceflow<4>(i); });
+      break;
+    default:
+      parallel_for(faces(),[&](int i, int) { perturbed[i] = _faceflow<0>(i); });
+      break;
+    }
   for ( i=0; i<faces(); i++ )
+    if (perturbed[i])
+      {
+	cout << "Face with more than 2 attract/repel switches! Trying a random perturbation..." << endl;
+	cout << "Index: " << i << " " << f0[i];
+	cout << "--->" << f[i] << endl;
+      }
+  delete[] f0;
+
+  // fill eflow...
+  eflow = new unsigned char[edges()];
+  parallel_for(edges(),[&](int i, int) { _edgeflow(i,BD); });
+
+  // fill proj
+  proj0 = new greal[faceoffset(faces())>>1];
+  proj1 = new greal[faceoffset(faces())];
+  bool *inconsistent = perturbed;
+  switch(facedegree())
+    {
+    case 3:
+      parallel_for(faces(),[&](int i, int) { inconsistent[i] = !_faceproj<3>(i); });
+      break;
+    case 4:
+      parallel_for(faces(),[&](int i, int) { inconsistent[i] = !_faceproj<4>(i); });
+      break;
+    default:
+      parallel_for(faces(),[&](int i, int) { inconsistent[i] = !_faceproj<0>(i); });
+      break;
+    }
+  for ( i=0; i<faces(); i++ )
+    if (inconsistent[i])
+      {
+	cout << "Projection along vector field are inconsistent, ans so may be the output...." << endl;
+	cout << "Try applying a small random perturbation to the vector field." << endl;
+	cout << "If this does not work, check mesh for consistency." << endl;
+	assert(0);
+      }
+  delete[] perturbed;
+
+  // fill the vertex data now...
+  
+  indx = new int[vertices()];
+  indx2 = new int[vertices()];
+  isstat = new bool[vertices()];
+  spiral = new bool[vertices()];
+
+  // per-worker scratch space for the vertex classification
+  int maxcofaces = 0;
+  for ( i=0; i<vertices(); i++ )
+    if (getvertex(i)->cofaces>maxcofaces)
+      maxcofaces = getvertex(i)->cofaces;
+  unsigned char *scratch = new unsigned char[threads()*maxcofaces+1];
+
+  parallel_for(vertices(),[&](int i, int t) { _vertexdata(i,BD,scratch+t*maxcofaces); });
+
+  delete[] scratch;
+}
+
+/* ------------------------------------------------------ */
+
+pcvf::pcvf ( const pcvf *base ) :
+  vfield_base(base), f(base->f), pvf(base->pvf), 
+  proj0(base->proj0), proj1(base->proj1), 
+  isstat(base->isstat), indx(base->indx), indx2(base->indx2), spiral(base->spiral),
+  frefs(base->frefs)
+{
+  aflow = new unsigned short[faces()];
+  rflow = new unsigned short[faces()];
+  eflow = new unsigned char[edges()];
+  for ( int i=0; i<faces(); i++ )
     {
-      int j;
+      aflow[i] = base->aflow[i];
+      rflow[i] = base->rflow[i];
+    }
+  for ( int i=0; i<edges(); i++ )
+    eflow[i] = base->eflow[i];
+}
+
+/* ------------------------------------------------------ */
 
-      mesh_element *ff = getface(i);
-      aflow[i] = new bool[ff->faces];
-      rflow[i] = new bool[ff->faces];
+template<int D>
+bool pcvf::_faceflow ( int i )
+{
+  int j;
+
+  mesh_element *ff = getface(i);
+  const int m = D ? 2*D : ff->faces;  // number of boundary elements
+  unsigned short a;
+  bool perturbed = false;
+
+  // the random perturbations depend on the face index only, so
+  // that the result does not depend on the order faces are processed in
+  unsigned short xsubi[3] = { 0x330E, (unsigned short)i, (unsigned short)(i>>16) };
+
+  while(1)
+    {
       int crossings = 0;  // this is for consistency check...
 
-      while(1)
+      a = 0;
+      for ( j=0; j<m; j+=2 )
 	{
-	  for ( j=0; j<ff->faces; j+=2 )
-	    {
-	      vec3dd ev = v[ff->face[j+1]->ID] - v[ff->face[(j+ff->faces-1)%(ff->faces)]->ID];
-	      vec3dd ei = n[i]^ev;
-	      double tst = ei*(v[ff->face[(j+3)%ff->faces]->ID]-v[ff->face[j+1]->ID]);
-	      assert(tst!=0);
-	      if (tst<0)
-		ei = -ei;
-	      aflow[i][j] = (ei*f[i]<0);
-	      rflow[i][j] = !aflow[i][j];
-	      if (j && (aflow[i][j]^aflow[i][j-2])) crossings++;
-	    }
-	  if (aflow[i][0]^aflow[i][ff->faces-2]) crossings++;
-
-	  if (crossings!=2)
-	    {
-	      cout << "Face with more than 2 attract/repel switches! Trying a random perturbation..." << endl;
-	      cout << "Index: " << i << " " << f[i];
-	      f[i] = 1e-6*randomv3<double>();
-	      cout << "--->" << f[i] << endl;
-	    }
-	  else
-	    break;
+	  vec3dd ev = vertex(ff->face[j+1]->ID) - vertex(ff->face[(j+m-1)%m]->ID);
+	  vec3dd ei = normal(i)^ev;
+	  double tst = ei*(vertex(ff->face[(j+3)%m]->ID)-vertex(ff->face[j+1]->ID));
+	  assert(tst!=0);
+	  if (tst<0)
+	    ei = -ei;
+	  if (ei*getvector(i)<0)
+	    a |= 1<<j;
+	  if (j && (((a>>j)^(a>>(j-2)))&1)) crossings++;
 	}
+      if ((a^(a>>(m-2)))&1) crossings++;
 
-      aflow[i][ff->faces-1] = aflow[i][ff->faces-2] && aflow[i][0];
-      rflow[i][ff->faces-1] = rflow[i][ff->faces-2] && rflow[i][0];
-      for ( j=1; j<ff->faces-2; j+=2 )
+      if (crossings!=2)
 	{
-	  aflow[i][j] = aflow[i][j-1] && aflow[i][j+1];
-	  rflow[i][j] = rflow[i][j-1] && rflow[i][j+1];
+	  f[i] = 1e-6*randomv3<double>(xsubi);
+	  perturbed = true;
 	}
+      else
+	break;
     }
 
-  // fill eflow...
-  eflow = new unsigned char[edges()];
-  for ( i=0; i<edges(); i++ )
+  aflow[i] = _vertexbits(a,m);
+  rflow[i] = _vertexbits(~a,m);
+
+  return perturbed;
+}
+
+/* ------------------------------------------------------ */
+
+void pcvf::_edgeflow ( int i, bool BD )
+{
+  mesh_element *ee = getedge(i);
+  vec3dd evc = vertex(ee->face[1]->ID)-vertex(ee->face[0]->ID);
+  switch(ee->cofaces)
     {
-      mesh_element *ee = getedge(i);
-      vec3dd evc = v[ee->face[1]->ID]-v[ee->face[0]->ID];
-      switch(ee->cofaces)
-	{
-	case 1:
+    case 1:
+      {
+	// boundary edge - has flow for sure!
+	eflow[i] = 0;
+	if (BD)
 	  {
-	    // boundary edge - has flow for sure!
-	    eflow[i] = 0;
-	    if (BD)
-	      {
-		if (evc*f[ee->coface[0]->ID]>0)
-		  eflow[i] = 1;
-		else
-		  eflow[i] = 2;
-	      }
+	    if (evc*getvector(ee->coface[0]->ID)>0)
+	      eflow[i] = 1;
+	    else
+	      eflow[i] = 2;
 	  }
-	  break;
+      }
+      break;
 
-	case 2:
+    case 2:
+      {
+	vec3dd an = normal(ee->coface[1]->ID)+normal(ee->coface[0]->ID);
+	an.normalize();
+	vec3dd f1 = getvector(ee->coface[0]->ID)-(getvector(ee->coface[0]->ID)*an)*an;
+	vec3dd f2 = getvector(ee->coface[1]->ID)-(getvector(ee->coface[1]->ID)*an)*an;
+	vec3dd ev = vertex(ee->face[1]->ID) - vertex(ee->face[0]->ID);
+	vec3dd pp = ev^an;
+	double w1 = f2*pp;
+	double w2 = f1*pp;
+
+	if (attracts_flow(ee->coface[0]->ID,ee->cofix[0]) ^ 
+	    attracts_flow(ee->coface[1]->ID,ee->cofix[1]))
+	  eflow[i] = 0;
+	else
 	  {
-	    vec3dd an = n[ee->coface[1]->ID]+n[ee->coface[0]->ID];
-	    an.normalize();
-	    vec3dd f1 = f[ee->coface[0]->ID]-(f[ee->coface[0]->ID]*an)*an;
-	    vec3dd f2 = f[ee->coface[1]->ID]-(f[ee->coface[1]->ID]*an)*an;
-	    vec3dd ev = v[ee->face[1]->ID] - v[ee->face[0]->ID];
-	    vec3dd pp = ev^an;
-	    double w1 = f2*pp;
-	    double w2 = f1*pp;
-
-	    if (attracts_flow(ee->coface[0]->ID,ee->coface[0]->find_face_index(ee)) ^ 
-		attracts_flow(ee->coface[1]->ID,ee->coface[1]->find_face_index(ee)))
-	      eflow[i] = 0;
+	    assert(w1*w2<0);
+	    if ((fabs(w1)*f1+fabs(w2)*f2)*ev>0)
+	      eflow[i] = 1;
 	    else
-	      {
-		assert(w1*w2<0);
-		if ((fabs(w1)*f1+fabs(w2)*f2)*ev>0)
-		  eflow[i] = 1;
-		else
-		  eflow[i] = 2;
-	      }
+	      eflow[i] = 2;
 	  }
-	  break;
+      }
+      break;
 
-	default:
-	  assert(0);
-	  break;
-	}
+    default:
+      assert(0);
+      break;
     }
+}
 
-  // fill proj
-  proj0 = new double*[faces()];
-  proj1 = new double*[faces()];
-  for ( i=0; i<faces(); i++ )
+/* ------------------------------------------------------ */
+
+template<int D>
+bool pcvf::_faceproj ( int i )
+{
+  int j;
+  mesh_element *ff = getface(i);
+  const int m = D ? 2*D : ff->faces;  // number of boundary elements
+  greal *p0 = proj0+(faceoffset(i)>>1);
+  greal *p1 = proj1+faceoffset(i);
+  vec3dd cmass(0,0,0);
+  for ( j=1; j<m; j+=2 )
+    cmass += vertex(ff->face[j]->ID);
+  cmass *= (1.0/(m>>1));
+
+  // the check is on the projections before they are stored, which may 
+  // round them (see MDPC_FLOAT)
+  const vec3dd fn = getvector(i)^normal(i);
+  int check[2][2] = { {0,0}, {0,0} };
+  double first = 0, prev = 0;
+  for ( j=1; j<m; j+=2 )
     {
-      int j;
-      mesh_element *ff = getface(i);
-      proj0[i] = new double[ff->faces>>1];
-      proj1[i] = new double[ff->faces];
-      vec3dd cmass(0,0,0);
-      for ( j=1; j<ff->faces; j+=2 )
-	cmass += v[ff->face[j]->ID];
-      cmass *= (1.0/(ff->faces>>1));
-
-      int check[2][2] = { {0,0}, {0,0} };
-      for ( j=1; j<ff->faces; j+=2 )
-	{
-	  proj0[i][j>>1] = (f[i]^n[i])*(v[ff->face[j]->ID]-cmass);
-	  if (j>1)
-	    check[aflow[i][j-1] ? 0 : 1][proj0[i][j>>1]>=proj0[i][(j-2)>>1] ? 0 : 1] = 1;
-	}
-      check[aflow[i][0] ? 0 : 1][proj0[i][0]>=proj0[i][(j-2)>>1] ? 0 : 1] = 1;
-      if (check[0][0]+check[1][0]!=1 || check[1][0]+check[1][1]!=1 || 
-	  check[0][0]+check[1][0]!=1 || check[0][1]+check[1][1]!=1)
-	{
-	  cout << "Projection along vector field are inconsistent, ans so may be the output...." << endl;
-	  cout << "Try applying a small random perturbation to the vector field." << endl;
-	  cout << "If this does not work, check mesh for consistency." << endl;
-	  assert(0);
-	}
+      double p = fn*(vertex(ff->face[j]->ID)-cmass);
+      p0[j>>1] = p;
+      if (j>1)
+	check[pcvf::attracts_flow(i,j-1) ? 0 : 1][p>=prev ? 0 : 1] = 1;
+      else
+	first = p;
+      prev = p;
+    }
+  check[pcvf::attracts_flow(i,0) ? 0 : 1][first>=prev ? 0 : 1] = 1;
 
-      for ( j=0; j<ff->faces; j+=2 )
-	{
-	  proj1[i][j] = (f[i]^n[i])*(v[ff->face[j]->face[0]->ID]-cmass);
-	  proj1[i][j+1] = (f[i]^n[i])*(v[ff->face[j]->face[1]->ID]-cmass);
-	}
+  for ( j=0; j<m; j+=2 )
+    {
+      p1[j] = fn*(vertex(ff->face[j]->face[0]->ID)-cmass);
+      p1[j+1] = fn*(vertex(ff->face[j]->face[1]->ID)-cmass);
     }
 
-  // fill the vertex data now...
-  
-  indx = new int[vertices()];
-  indx2 = new int[vertices()];
-  isstat = new bool[vertices()];
-  spiral = new bool[vertices()];
+  return !(check[0][0]+check[1][0]!=1 || check[1][0]+check[1][1]!=1 || 
+	   check[0][0]+check[1][0]!=1 || check[0][1]+check[1][1]!=1);
+}
 
-  for ( i=0; i<vertices(); i++ )
-    {
-      int j;
-      mesh_element *cv = getvertex(i);
+/* ------------------------------------------------------ */
 
-      bool boundary = (cv->cofaces&1);
-      spiral[i] = false;
+void pcvf::_vertexdata ( int i, bool BD, unsigned char *st )
+{
+  int j;
+  mesh_element *cv = getvertex(i);
 
-      // sector counts
-      int sp = 0;
-      int up = 0;
-      int hy = 0;
-      int el = 0;
+  bool boundary = (cv->cofaces&1);
+  spiral[i] = false;
 
-      unsigned char *st = new unsigned char[cv->cofaces];
+  // sector counts
+  int sp = 0;
+  int up = 0;
+  int hy = 0;
+  int el = 0;
 
-      for ( j=0; j<cv->cofaces; j++ )
+  for ( j=0; j<cv->cofaces; j++ )
+    {
+      if (j&1)
 	{
-	  if (j&1)
-	    st[j] = aflow[cv->coface[j]->ID][cv->coface[j]->find_face_index(cv->coface[j-1])] |
-	      (aflow[cv->coface[j]->ID][cv->coface[j]->find_face_index(cv->coface[(j+1)%cv->cofaces])] << 1);
-	  else
+	  // the edges preceding and following the vertex in face coface[j]
+	  mesh_element *cf = cv->coface[j];
+	  int ep = cv->cofix[j]-1;
+	  int en = (cv->cofix[j]+1)%cf->faces;
+	  if (cf->face[ep]!=cv->coface[j-1])
 	    {
-	      st[j] = (cv->coface[j]->face[0]==cv) ? eflow[cv->coface[j]->ID] : (eflow[cv->coface[j]->ID]^3);
-	      if (st[j]==3) st[j]=0;
+	      int tmp = ep;
+	      ep = en;
+	      en = tmp;
 	    }
+	  st[j] = attracts_flow(cf->ID,ep) | (attracts_flow(cf->ID,en) << 1);
 	}
+      else
+	{
+	  st[j] = (cv->coface[j]->face[0]==cv) ? eflow[cv->coface[j]->ID] : (eflow[cv->coface[j]->ID]^3);
+	  if (st[j]==3) st[j]=0;
+	}
+    }
 
-      // st[i]: for even i, direction of flow along edge; 1: away, 2: toward the vertex
-      // for odd i: whether flow is attracted in the respective face
+  // st[i]: for even i, direction of flow along edge; 1: away, 2: toward the vertex
+  // for odd i: whether flow is attracted in the respective face
 
-      unsigned char lastdir = 0;   // 1: unstable, 2: stable
-      unsigned char firstdir = 0;  // 1: unstable, 2; stable
+  unsigned char lastdir = 0;   // 1: unstable, 2: stable
+  unsigned char firstdir = 0;  // 1: unstable, 2; stable
 
-      for ( j=0; j<cv->cofaces; j++ )
+  for ( j=0; j<cv->cofaces; j++ )
+    {
+      if (!(j&1))
 	{
-	  if (!(j&1))
-	    {
-	      // incident edge
+	  // incident edge
+
+	  if (!st[j])
+	    continue;  // skip over if no flow
 
-	      if (!st[j])
-		continue;  // skip over if no flow
-	      
-	      if (!firstdir)
+	  if (!firstdir)
+	    {
+	      lastdir = firstdir = st[j];
+	    }
+	  else
+	    {
+	      assert(j>0);
+	      if (st[j]==lastdir)
+		continue;
+	      if (lastdir==1)
 		{
-		  lastdir = firstdir = st[j];
+		  up++;
+		  if (st[j-1]>>1) el++;
+		  else hy++;
 		}
-	      else
+	      if (lastdir==2)
 		{
-		  assert(j>0);
-		  if (st[j]==lastdir)
-		    continue;
-		  if (lastdir==1)
-		    {
-		      up++;
-		      if (st[j-1]>>1) el++;
-		      else hy++;
-		    }
-		  if (lastdir==2)
-		    {
-		      sp++;
-		      if (st[j-1]>>1) hy++;
-		      else el++;
-		    }
-		  lastdir = st[j];
+		  sp++;
+		  if (st[j-1]>>1) hy++;
+		  else el++;
 		}
+	      lastdir = st[j];
 	    }
-	  else
-	    {
-	      // incident face
+	}
+      else
+	{
+	  // incident face
 
-	      if (st[j]==1 || st[j]==2)
-		continue;   // skip over if no (un)stable direction inside
+	  if (st[j]==1 || st[j]==2)
+	    continue;   // skip over if no (un)stable direction inside
 
-	      unsigned char code = st[j] ? 2 : 1;
+	  unsigned char code = st[j] ? 2 : 1;
 
-	      if (!firstdir)
+	  if (!firstdir)
+	    {
+	      lastdir = firstdir = code;
+	    }
+	  else
+	    {
+	      if (code==lastdir)
+		continue;
+	      if (lastdir==1)
 		{
-		  lastdir = firstdir = code;
+		  up++;
+		  hy++;
 		}
-	      else
+	      if (lastdir==2)
 		{
-		  if (code==lastdir)
-		    continue;
-		  if (lastdir==1)
-		    {
-		      up++;
-		      hy++;
-		    }
-		  if (lastdir==2)
-		    {
-		      sp++;
-		      hy++;
-		    }
-		  lastdir = code;
+		  sp++;
+		  hy++;
 		}
+	      lastdir = code;
 	    }
 	}
+    }
 
-      if (!firstdir)
+  if (!firstdir)
+    {
+      // no (un)stable directions
+      // spiral sink/source
+      if (BD || !boundary)
 	{
-	  // no (un)stable directions
-	  // spiral sink/source
-	  if (BD || !boundary)
-	    {
-	      indx[i] = indx2[i] = 1;
-	      isstat[i] = true;
-	      spiral[i] = true;
-	      delete[] st;
-	      continue;
-	    }
+	  indx[i] = indx2[i] = 1;
+	  isstat[i] = true;
+	  spiral[i] = true;
+	  return;
 	}
-    
-      if (boundary)
-	{
-	  if (BD)
-	    {
-	      if (lastdir==1) up++;
-	      else sp++;
+    }
 
-	      // add flow toward the boundary to get rid of it
-	      //  i.e. reduce to internal vertex case
-	      // adjust the sector counts 
+  if (boundary)
+    {
+      if (BD)
+	{
+	  if (lastdir==1) up++;
+	  else sp++;
 
-	      int hy2 = hy;
-	      int sp2 = sp;
-	      int up2 = up;
-	      int el2 = el;
+	  // add flow toward the boundary to get rid of it
+	  //  i.e. reduce to internal vertex case
+	  // adjust the sector counts 
 
-	      bool force_stat = false;
+	  int hy2 = hy;
+	  int sp2 = sp;
+	  int up2 = up;
+	  int el2 = el;
 
-	      switch(st[0] | (st[cv->cofaces-1]<<2))
-		{
-		case 5:
-		  // both unstable...
-		  hy+=2; sp++;
-		  up2--;
-		  if (!up2) up2 = 1;
-		  force_stat = true;
-		  break;
-		case 6:
-		case 9:
-		  // one unstable, one stable
-		  hy += 1;
-		  hy2+= 1;
-		  break;
-		case 10:
-		  // both stable
-		  sp--;
-		  if (!sp) sp = 1;
-		  hy2+=2; up2++;
-		  force_stat = true;
-		  break;
-		default:
-		  assert(0);
-		}
+	  bool force_stat = false;
 
-	      delete[] st;
-	      indx[i] = 1+(el-hy)/2;
-	      indx2[i] = 1+(el2-hy2)/2;
-	      isstat[i] = (el || !(sp==1 && up==1 && hy==2) || el2 || !(sp2==1 && up2==1 && hy2==2) || force_stat);
-	      continue;
-	    }
-	  else
+	  switch(st[0] | (st[cv->cofaces-1]<<2))
 	    {
-	      isstat[i] = false;
-	      indx[i] = indx2[i] = 0;
-	      spiral[i] = false;
-	      delete[] st;
-	      continue;
+	    case 5:
+	      // both unstable...
+	      hy+=2; sp++;
+	      up2--;
+	      if (!up2) up2 = 1;
+	      force_stat = true;
+	      break;
+	    case 6:
+	    case 9:
+	      // one unstable, one stable
+	      hy += 1;
+	      hy2+= 1;
+	      break;
+	    case 10:
+	      // both stable
+	      sp--;
+	      if (!sp) sp = 1;
+	      hy2+=2; up2++;
+	      force_stat = true;
+	      break;
+	    default:
+	      assert(0);
 	    }
+
+	  indx[i] = 1+(el-hy)/2;
+	  indx2[i] = 1+(el2-hy2)/2;
+	  isstat[i] = (el || !(sp==1 && up==1 && hy==2) || el2 || !(sp2==1 && up2==1 && hy2==2) || force_stat);
+	  return;
 	}
       else
 	{
-	  if (lastdir!=firstdir)
+	  isstat[i] = false;
+	  indx[i] = indx2[i] = 0;
+	  spiral[i] = false;
+	  return;
+	}
+    }
+  else
+    {
+      if (lastdir!=firstdir)
+	{
+	  // need to add a hyperbolic or elliptic sector
+	  if (firstdir==1)
 	    {
-	      // need to add a hyperbolic or elliptic sector
-	      if (firstdir==1)
-		{
-		  assert(lastdir==2);
-		  sp++;
-		  if (st[cv->cofaces-1]>>1)
-		    hy++;
-		  else
-		    el++;
-		}
+	      assert(lastdir==2);
+	      sp++;
+	      if (st[cv->cofaces-1]>>1)
+		hy++;
 	      else
-		{
-		  assert(lastdir==1);
-		  assert(firstdir==2);
-		  up++;
-		  if (st[cv->cofaces-1]>>1)
-		    el++;
-		  else
-		    hy++;
-		}
+		el++;
 	    }
 	  else
 	    {
-	      if (sp==0 && up==0)
-		if (lastdir==2)
-		  sp++;
-		else
-		  up++;
+	      assert(lastdir==1);
+	      assert(firstdir==2);
+	      up++;
+	      if (st[cv->cofaces-1]>>1)
+		el++;
+	      else
+		hy++;
 	    }
+	}
+      else
+	{
+	  if (sp==0 && up==0)
+	    if (lastdir==2)
+	      sp++;
+	    else
+	      up++;
+	}
+
+      indx2[i] = indx[i] = 1+(el-hy)/2;
+      isstat[i] = (el || !(sp==1 && up==1 && hy==2));
+    }
+}
+
+/* ------------------------------------------------------ */
+
+bool pcvf::update ( std::istream &is, char type, double tol, bool BD, bool *changed )
+{
+  int i,j;
+
+  for ( i=0; i<faces(); i++ )
+    changed[i] = false;
 
-	  indx2[i] = indx[i] = 1+(el-hy)/2;
-	  isstat[i] = (el || !(sp==1 && up==1 && hy==2));
-	  delete[] st;
-	  continue;
+  if (type=='v')
+    {
+      assert(pvf);
+      vec3dg *nv = new vec3dg[(unsigned)vertices()];
+      for ( i=0; i<vertices(); i++ )
+	{
+	  is >> nv[i][0] >> nv[i][1] >> nv[i][2];
+	  if (!is)
+	    {
+	      delete[] nv;
+	      return false;
+	    }
 	}
+      // faces of the vertices that changed get their vector again
+      for ( i=0; i<vertices(); i++ )
+	if ((vec3dd(nv[i])-vec3dd(pvf[i])).norm()>tol)
+	  {
+	    pvf[i] = nv[i];
+	    mesh_element *cv = getvertex(i);
+	    for ( j=1; j<cv->cofaces; j+=2 )
+	      changed[cv->coface[j]->ID] = true;
+	  }
+      delete[] nv;
+      for ( i=0; i<faces(); i++ )
+	if (changed[i])
+	  {
+	    vec3dd fi(0,0,0);
+	    for ( j=1; j<getface(i)->faces; j+=2 )
+	      fi += pvf[getface(i)->face[j]->ID];
+	    fi *= (2.0/getface(i)->faces);
+	    f[i] = fi;
+	    project_out(1,f+i,n+i);
+	  }
+    }
+  else
+    {
+      assert(type=='f');
+      vec3dg *nf = new vec3dg[(unsigned)faces()];
+      for ( i=0; i<faces(); i++ )
+	{
+	  is >> nf[i][0] >> nf[i][1] >> nf[i][2];
+	  if (!is)
+	    {
+	      delete[] nf;
+	      return false;
+	    }
+	}
+      project_out(faces(),nf,n);
+      for ( i=0; i<faces(); i++ )
+	if ((vec3dd(nf[i])-getvector(i)).norm()>tol)
+	  {
+	    f[i] = nf[i];
+	    changed[i] = true;
+	  }
+      delete[] nf;
+    }
+
+  // what depends on the changed faces, as in the constructor: their flow 
+  // and projections, then the flow of their edges, then their vertices
+  vector<int> cf,ce,cv;
+  bool *emark = new bool[edges()];
+  bool *vmark = new bool[vertices()];
+  for ( i=0; i<edges(); i++ )
+    emark[i] = false;
+  for ( i=0; i<vertices(); i++ )
+    vmark[i] = false;
+  for ( i=0; i<faces(); i++ )
+    if (changed[i])
+      {
+	cf.push_back(i);
+	mesh_element *ff = getface(i);
+	for ( j=0; j<ff->faces; j++ )
+	  {
+	    int id = ff->face[j]->ID;
+	    if (j&1)
+	      {
+		if (!vmark[id])
+		  cv.push_back(id);
+		vmark[id] = true;
+	      }
+	    else
+	      {
+		if (!emark[id])
+		  ce.push_back(id);
+		emark[id] = true;
+	      }
+	  }
+      }
+  delete[] emark;
+  delete[] vmark;
+
+  bool *perturbed = new bool[cf.size()];
+  vec3dd *f0 = new vec3dd[cf.size()];
+  for ( i=0; i<cf.size(); i++ )
+    f0[i] = f[cf[i]];
+  switch(facedegree())
+    {
+    case 3:
+      parallel_for(cf.size(),[&](int k, int) { perturbed[k] = _faceflow<3>(cf[k]); });
+      break;
+    case 4:
+      parallel_for(cf.size(),[&](int k, int) { perturbed[k] = _faceflow<4>(cf[k]); });
+      break;
+    default:
+      parallel_for(cf.size(),[&](int k, int) { perturbed[k] = _faceflow<0>(cf[k]); });
+      break;
+    }
+  for ( i=0; i<cf.size(); i++ )
+    if (perturbed[i])
+      {
+	cout << "Face with more than 2 attract/repel switches! Trying a random perturbation..." << endl;
+	cout << "Index: " << cf[i] << " " << f0[i];
+	cout << "--->" << f[cf[i]] << endl;
+      }
+  delete[] f0;
+
+  parallel_for(ce.size(),[&](int k, int) { _edgeflow(ce[k],BD); });
+
+  bool *inconsistent = perturbed;
+  switch(facedegree())
+    {
+    case 3:
+      parallel_for(cf.size(),[&](int k, int) { inconsistent[k] = !_faceproj<3>(cf[k]); });
+      break;
+    case 4:
+      parallel_for(cf.size(),[&](int k, int) { inconsistent[k] = !_faceproj<4>(cf[k]); });
+      break;
+    default:
+      parallel_for(cf.size(),[&](int k, int) { inconsistent[k] = !_faceproj<0>(cf[k]); });
+      break;
     }
+  for ( i=0; i<cf.size(); i++ )
+    if (inconsistent[i])
+      {
+	cout << "Projection along vector field are inconsistent, ans so may be the output...." << endl;
+	cout << "Try applying a small random perturbation to the vector field." << endl;
+	cout << "If this does not work, check mesh for consistency." << endl;
+	assert(0);
+      }
+  delete[] perturbed;
+
+  int maxcofaces = 0;
+  for ( i=0; i<cv.size(); i++ )
+    if (getvertex(cv[i])->cofaces>maxcofaces)
+      maxcofaces = getvertex(cv[i])->cofaces;
+  unsigned char *scratch = new unsigned char[threads()*maxcofaces+1];
+  parallel_for(cv.size(),[&](int k, int t) { _vertexdata(cv[k],BD,scratch+t*maxcofaces); });
+  delete[] scratch;
+
+  return true;
 }
 
 /* ------------------------------------------------------ */
 
 pcvf::~pcvf()
 {
+  if (eflow) delete[] eflow;
+  eflow = NULL;
+  if (aflow) delete[] aflow;
+  aflow = NULL;
+  if (rflow) delete[] rflow;
+  rflow = NULL;
+  if (!frefs.release())
+    return;
   if (f) delete[] f;
   f = NULL;
   if (pvf) delete[] pvf;
@@ -458,23 +804,6 @@ pcvf::~pcvf()
   indx2 = NULL;
   if (spiral) delete[] spiral;
   spiral = NULL;
-  if (eflow) delete[] eflow;
-  eflow = NULL;
-  for ( int i=0; i<faces(); i++ )
-    {
-      if (aflow[i]) delete[] aflow[i];
-      aflow[i] = NULL;
-      if (rflow[i]) delete[] rflow[i];
-      rflow[i] = NULL;
-      if (proj0[i]) delete[] proj0[i];
-      proj0[i] = NULL;
-      if (proj1[i]) delete[] proj1[i];
-      proj1[i] = NULL;
-    }
-  if (aflow) delete[] aflow;
-  aflow = NULL;
-  if (rflow) delete[] rflow;
-  rflow = NULL;
   if (proj0) delete[] proj0;
   proj0 = NULL;
   if (proj1) delete[] proj1;
@@ -499,14 +828,23 @@ bool pcvf::hasflowdown ( int i )
 
 bool pcvf::attracts_flow ( int fce, int eix )
 {
-  return aflow[fce][eix];
+  return (aflow[fce]>>eix)&1;
 }
 
 /* ------------------------------------------------------ */
 
 bool pcvf::repels_flow ( int fce, int eix )
 {
-  return rflow[fce][eix];
+  return (rflow[fce]>>eix)&1;
+}
+
+/* ------------------------------------------------------ */
+
+unsigned short pcvf::_vertexbits ( unsigned short m, int k )
+{
+  unsigned short e = m & 0x5555 & ((1<<k)-1);
+  unsigned short next = (e>>2) | ((e&1)<<(k-2));  // bit j: edge j+2 (cyclic)
+  return e | ((e&next)<<1);
 }
 
 /* ------------------------------------------------------ */
@@ -565,10 +903,13 @@ static void swap ( double &a, double &b )
 bool pcvf::connects ( int fce, int eix1, int eix2, 
 		      double s1, double e1, double s2, double e2 )
 {
+  const greal *p0 = proj0+(faceoffset(fce)>>1);
+  const greal *p1 = proj1+faceoffset(fce);
+
   if ( (eix1&1) && (eix2&1) )
     {
       // both are vertices
-      return proj0[fce][eix1>>1]==proj0[fce][eix2>>1];
+      return p0[eix1>>1]==p0[eix2>>1];
     }
 
   if ( (eix1&1) && !(eix2&1) )
@@ -576,12 +917,12 @@ bool pcvf::connects ( int fce, int eix1, int eix2,
       // vertex and edge piece
 
       double a2,b2;
-      a2 = proj1[fce][eix2];
-      b2 = proj1[fce][eix2+1];
+      a2 = p1[eix2];
+      b2 = p1[eix2+1];
       double s = (1-s2)*a2+s2*b2;
       double e = (1-e2)*a2+e2*b2;
       if (s>e) swap(s,e);
-      double p = proj0[fce][eix1>>1];
+      double p = p0[eix1>>1];
       return s<=p && p<=e;
     }
 
@@ -590,12 +931,12 @@ bool pcvf::connects ( int fce, int eix1, int eix2,
       // vertex and edge piece
 
       double a1,b1;
-      a1 = proj1[fce][eix1];
-      b1 = proj1[fce][eix1+1];
+      a1 = p1[eix1];
+      b1 = p1[eix1+1];
       double s = (1-s1)*a1+s1*b1;
       double e = (1-e1)*a1+e1*b1;
       if (s>e) swap(s,e);
-      double p = proj0[fce][eix2>>1];
+      double p = p0[eix2>>1];
       return s<=p && p<=e;
     }
 
@@ -604,15 +945,15 @@ bool pcvf::connects ( int fce, int eix1, int eix2,
       // both edges
 
       double a2,b2;
-      a2 = proj1[fce][eix2];
-      b2 = proj1[fce][eix2+1];
+      a2 = p1[eix2];
+      b2 = p1[eix2+1];
       double ss2 = (1-s2)*a2+s2*b2;
       double ee2 = (1-e2)*a2+e2*b2;
       if (ss2>ee2) swap(ss2,ee2);
 
       double a1,b1;
-      a1 = proj1[fce][eix1];
-      b1 = proj1[fce][eix1+1];
+      a1 = p1[eix1];
+      b1 = p1[eix1+1];
       double ss1 = (1-s1)*a1+s1*b1;
       double ee1 = (1-e1)*a1+e1*b1;
       if (ss1>ee1) swap(ss1,ee1);
@@ -620,6 +961,109 @@ bool pcvf::connects ( int fce, int eix1, int eix2,
     }
 }
 
+/* ------------------------------------------------------ */
+
+#ifdef __AVX2__
+// the projections p[i[l]] for the lanes l where m is all ones (0 for the 
+// others), as doubles
+static inline __m256d _gatherproj ( const double *p, __m128i i, __m128i m )
+{
+  return _mm256_mask_i32gather_pd(_mm256_setzero_pd(),p,i,_mm256_castsi256_pd(_mm256_cvtepi32_epi64(m)),8);
+}
+
+static inline __m256d _gatherproj ( const float *p, __m128i i, __m128i m )
+{
+  return _mm256_cvtps_pd(_mm_mask_i32gather_ps(_mm_setzero_ps(),p,i,_mm_castsi128_ps(m),4));
+}
+#endif
+
+/* ------------------------------------------------------ */
+
+// same as connects() for each query, without branches: a vertex is treated
+// as the interval [p,p] with s=e=0, which leaves its projection p exact
+
+void pcvf::connects_batch ( int cnt, const cquery *q, unsigned char *res )
+{
+  int k = 0;
+
+#ifdef __AVX2__
+  // four queries at a time; the fields of q are gathered with the size 
+  // of cquery as the stride
+  const int qi = sizeof(cquery)/sizeof(int);
+  const int qd = sizeof(cquery)/sizeof(double);
+  const __m128i one = _mm_set1_epi32(1);
+  const __m256d ones = _mm256_set1_pd(1.0);
+
+  for ( ; k+4<=cnt; k+=4 )
+    {
+      __m128i ii = _mm_setr_epi32(k*qi,(k+1)*qi,(k+2)*qi,(k+3)*qi);
+      __m128i id = _mm_setr_epi32(k*qd,(k+1)*qd,(k+2)*qd,(k+3)*qd);
+      const int *qb = (const int*)q;
+      const double *qf = (const double*)q;
+
+      __m128i fce = _mm_i32gather_epi32(qb+offsetof(cquery,fce)/sizeof(int),ii,4);
+      __m128i o = _mm_i32gather_epi32(foff,fce,4);
+      __m256d lo[2],hi[2];
+
+      for ( int side=0; side<2; side++ )
+	{
+	  __m128i eix = _mm_i32gather_epi32(qb+(side ? offsetof(cquery,eix2) : offsetof(cquery,eix1))/sizeof(int),ii,4);
+	  __m256d s = _mm256_i32gather_pd(qf+(side ? offsetof(cquery,s2) : offsetof(cquery,s1))/sizeof(double),id,8);
+	  __m256d e = _mm256_i32gather_pd(qf+(side ? offsetof(cquery,e2) : offsetof(cquery,e1))/sizeof(double),id,8);
+
+	  __m128i isv = _mm_cmpeq_epi32(_mm_and_si128(eix,one),one);
+	  __m128i ise = _mm_andnot_si128(isv,_mm_set1_epi32(-1));
+	  __m256d vmask = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(isv));
+	  __m128i i0 = _mm_add_epi32(_mm_srli_epi32(o,1),_mm_srli_epi32(eix,1));
+	  __m128i i1 = _mm_add_epi32(o,eix);
+
+	  __m256d p = _gatherproj(proj0,i0,isv);
+	  __m256d a = _mm256_blendv_pd(_gatherproj(proj1,i1,ise),p,vmask);
+	  __m256d b = _mm256_blendv_pd(_gatherproj(proj1+1,i1,ise),p,vmask);
+	  s = _mm256_andnot_pd(vmask,s);
+	  e = _mm256_andnot_pd(vmask,e);
+
+	  __m256d ss = _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(ones,s),a),_mm256_mul_pd(s,b));
+	  __m256d ee = _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(ones,e),a),_mm256_mul_pd(e,b));
+	  lo[side] = _mm256_min_pd(ss,ee);
+	  hi[side] = _mm256_max_pd(ss,ee);
+	}
+
+      __m256d apart = _mm256_or_pd(_mm256_cmp_pd(hi[0],lo[1],_CMP_LT_OQ),
+				   _mm256_cmp_pd(hi[1],lo[0],_CMP_LT_OQ));
+      int m = _mm256_movemask_pd(apart);
+      for ( int l=0; l<4; l++ )
+	res[k+l] = !((m>>l)&1);
+    }
+#endif
+
+  for ( ; k<cnt; k++ )
+    {
+      const cquery &c = q[k];
+      int o = faceoffset(c.fce);
+
+      bool v1 = c.eix1&1;
+      const greal *x1 = v1 ? proj0+(o>>1)+(c.eix1>>1) : proj1+o+c.eix1;
+      double a1 = x1[0];
+      double b1 = x1[v1 ? 0 : 1];
+      double s1 = v1 ? 0 : c.s1;
+      double e1 = v1 ? 0 : c.e1;
+      double ss1 = (1-s1)*a1+s1*b1;
+      double ee1 = (1-e1)*a1+e1*b1;
+
+      bool v2 = c.eix2&1;
+      const greal *x2 = v2 ? proj0+(o>>1)+(c.eix2>>1) : proj1+o+c.eix2;
+      double a2 = x2[0];
+      double b2 = x2[v2 ? 0 : 1];
+      double s2 = v2 ? 0 : c.s2;
+      double e2 = v2 ? 0 : c.e2;
+      double ss2 = (1-s2)*a2+s2*b2;
+      double ee2 = (1-e2)*a2+e2*b2;
+
+      res[k] = !(max(ss1,ee1)<min(ss2,ee2) || max(ss2,ee2)<min(ss1,ee1));
+    }
+}
+
 
 /* ------------------------------------------------------ */
 
@@ -637,7 +1081,7 @@ void pcvf::print_out()
     {
       cout << i << " ";
       for ( j=0; j<getface(i)->faces; j++ )
-	cout << (aflow[i][j] ? '1' : '0') << (rflow[i][j] ? '1' : '0') << " ";
+	cout << (attracts_flow(i,j) ? '1' : '0') << (repels_flow(i,j) ? '1' : '0') << " ";
       cout << endl;
     }
   cout << " ---------------------- " << endl;
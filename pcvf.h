@@ -37,19 +37,37 @@ class pcvf : public vfield_base {
 
  protected:
 
-  vec3dd *f;
-  vec3dd *pvf;   // per vertex vector values; NULL if file contains only per-face values
+  vec3dg *f;
+  vec3dg *pvf;   // per vertex vector values; NULL if file contains only per-face values
 
   // precomputed stuff ...
 
-  bool **aflow;           // attracts flow [edge rel face]?
-  bool **rflow;           // attracts flow [edge rel face]?
+  // bit j of aflow[i] (rflow[i]): boundary element j of face i attracts
+  // (repels) flow; faces have at most 16 boundary elements
+  unsigned short *aflow;
+  unsigned short *rflow;
 
   unsigned char *eflow;   // bit 0: up, bit 1: down
 
-  // projections of vertices along face's vector
-  double **proj0;
-  double **proj1;
+  // projections of vertices along face's vector; for face i, proj0 holds 
+  // one value per vertex from faceoffset(i)/2 on and proj1 two (one per 
+  // endpoint) per edge from faceoffset(i) on
+  greal *proj0;
+  greal *proj1;
+
+  // edge bits of m with the vertex bits set where both adjacent edges' 
+  // bits are set; k is the number of boundary elements of the face
+  static unsigned short _vertexbits ( unsigned short m, int k );
+
+  // per-element parts of the constructor; each writes only the data of 
+  // element i, so they can run in parallel over the elements of one kind.
+  // D>0 is the number of edges of every face (triangle or quad meshes, 
+  // see facedegree()), known at compile time; D=0 handles any polygons
+  template<int D> bool _faceflow ( int i );   // aflow, rflow; true if f[i] had to be perturbed
+  void _edgeflow ( int i, bool BD );   // eflow
+  template<int D> bool _faceproj ( int i );   // proj0, proj1; false if inconsistent
+  // isstat, indx, indx2, spiral; st is scratch space, one byte per coface
+  void _vertexdata ( int i, bool BD, unsigned char *st );
 
   // vertex data
   bool *isstat;  // stationary or not
@@ -57,6 +75,15 @@ class pcvf : public vfield_base {
   int *indx2;    //  for boundary vertices assumes flow escaping from the domain
   bool *spiral;  // spiral or not
 
+  refcount frefs;  // pcvfs sharing f, pvf, proj0, proj1 and the vertex data
+
+  // the parts of the constructors: _read reads the vectors of the field 
+  // (per face or per vertex, see type below) from is, or from b if it is
+  // not NULL, into f and pvf, name is for messages; _compute projects them
+  // to the faces and fills the rest
+  void _read ( std::istream &is, binfile *b, const char *name, char type );
+  void _compute ( bool BD );
+
  public:
 
   // type='f' if per-face vector value,
@@ -66,8 +93,27 @@ class pcvf : public vfield_base {
   // bd=false: allow flow across boundary edges
   pcvf ( const char *name, char type = 'f', bool BD = true );
 
+  // another field on m's mesh, which it shares (topology and geometry): 
+  // the file name holds only its vectors, in the order of m's faces or 
+  // vertices, as they follow the mesh in the file of the constructor above
+  pcvf ( const pcvf *m, const char *name, char type = 'f', bool BD = true );
+
+  // a copy of base for derived fields (pcstable etc) to adjust: shares 
+  // base's mesh and all of its data except aflow, rflow and eflow, which
+  // are copied; base stays unchanged and can be deleted first
+  pcvf ( const pcvf *base );
+
   virtual ~pcvf();
 
+  // reads the vectors of the next frame of a time series on the same mesh
+  // (per face or per vertex, as type for the constructor) from is, and 
+  // recomputes the data of the faces, edges and vertices they affect only;
+  // a vector (of a face, or of a vertex for type 'v') is kept if it changed 
+  // by at most tol. changed (one flag per face) gets the faces whose 
+  // vectors changed. Returns false if is ends before the frame does.
+  // Fields derived from this one have to be built again.
+  bool update ( std::istream &is, char type, double tol, bool BD, bool *changed );
+
   vec3dd getvector ( int i );
 
   // see vfield_base for comments on fuctions below
@@ -85,6 +131,8 @@ class pcvf : public vfield_base {
   virtual bool connects ( int fce, int eix1, int eix2, 
 			  double s1 = 0, double e1 = 1, 
 			  double s2 = 0, double e2 = 1 );
+  // branch-free; uses AVX2 if compiled for it
+  virtual void connects_batch ( int cnt, const cquery *q, unsigned char *res );
 
 
   void print_out();
@@ -26,7 +26,17 @@
 
 #include <tgraph.h>
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 #include <primitive.h>
+#include <pcstable.h>
+#include <pcenv.h>
+#include <parallel.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #define SIX0 2
 #define SIX1 6
@@ -36,15 +46,12 @@ using namespace std;
 
 /* ------------------------------------------------------ */
 
-int arc::arcs = 0;
-int node::nodes = 0;
 
 /* ------------------------------------------------------ */
 
 node::node ( int id, mesh_element *o ) : 
   owner(o), in(), out(), left(NULL), right(NULL), s(0), e(0), scc(-1), flags(0), ID(id)
 {
-  nodes++;
 }
 
 /* ------------------------------------------------------ */
@@ -52,7 +59,6 @@ node::node ( int id, mesh_element *o ) :
 node::node ( int id, mesh_element *o, node *l, node *r, double ss, double ee ) :
   owner(o), in(), out(), left(l), right(r), s(ss), e(ee), scc(-1), flags(0), ID(id)
 {
-  nodes++;
 }
 
 /* ------------------------------------------------------ */
@@ -73,7 +79,6 @@ node::~node()
       assert(right->left==this);
       right->left = NULL;
     }
-  nodes--;
 }
 
 /* ------------------------------------------------------ */
@@ -119,51 +124,68 @@ bool node::islockedL()
 
 /* ------------------------------------------------------ */
 
-void node::markf ( unsigned char msk, vector<node*> *lst )
+double node::span()
+{
+  return e-s;
+}
+
+/* ------------------------------------------------------ */
+
+nodemark::nodemark() : stamp(), epoch(0)
 {
-  stack<node*> S;
+}
 
-  S.push(this);
-  while (!S.empty())
+/* ------------------------------------------------------ */
+
+void nodemark::reset ( int size )
+{
+  if (stamp.size()<size)
+    stamp.resize(size,0);
+  if (++epoch==0)
     {
-      node *c = S.top();
-      S.pop();
-      unsigned char ofl = c->flags;
-      c->flags |= msk;
-      if (ofl==c->flags)
-	continue;
-      if (lst) lst->push_back(c);
-      for ( int i=0; i<c->out.size(); i++ )
-	S.push(c->out[i]->to);
+      // wrapped around: stamps from 2^32 traversals ago would look current
+      fill(stamp.begin(),stamp.end(),0);
+      epoch = 1;
     }
 }
 
 /* ------------------------------------------------------ */
 
-void node::markb ( unsigned char msk, vector<node*> *lst )
+void nodemark::grow ( int size )
 {
-  stack<node*> S;
+  if (stamp.size()<size)
+    stamp.resize(size,0);
+}
 
-  S.push(this);
-  while (!S.empty())
-    {
-      node *c = S.top();
-      S.pop();
-      unsigned char ofl = c->flags;
-      c->flags |= msk;
-      if (ofl==c->flags)
-	continue;
-      if (lst) lst->push_back(c);
-      for ( int i=0; i<c->in.size(); i++ )
-	S.push(c->in[i]->from);
-    }
+/* ------------------------------------------------------ */
+
+bool nodemark::test ( int id )
+{
+  return stamp[id]==epoch;
 }
 
 /* ------------------------------------------------------ */
 
-double node::span()
+void nodemark::set ( int id )
 {
-  return e-s;
+  stamp[id] = epoch;
+}
+
+/* ------------------------------------------------------ */
+
+bool nodemark::testset ( int id )
+{
+  if (stamp[id]==epoch)
+    return true;
+  stamp[id] = epoch;
+  return false;
+}
+
+/* ------------------------------------------------------ */
+
+void nodemark::unset ( int id )
+{
+  stamp[id] = 0;
 }
 
 /* ------------------------------------------------------ */
@@ -179,8 +201,22 @@ arc::arc ( node *f, node *t, mesh_element *carrier, int ix_orig, int ix_dest ) :
 
   t->in.push_back(this);
   f->out.push_back(this);
+}
 
-  arcs++;
+/* ------------------------------------------------------ */
+
+// index of m in its coface c, from m's coface index table; faces of a 
+// vertex are at the odd positions of its coface list
+
+static int _faceindex ( mesh_element *m, mesh_element *c )
+{
+  int k = (m->dimension==0 && c->dimension==2) ? 1 : 0;
+  int d = k+1;
+  for ( ; k<m->cofaces; k+=d )
+    if (m->coface[k]==c)
+      return m->cofix[k];
+  assert(0);
+  return -1;
 }
 
 /* ------------------------------------------------------ */
@@ -198,17 +234,16 @@ arc::arc ( node *f, node *t, mesh_element *carrier ) :
       break;
     case 2:
       {
-	int ix_orig = carrier->find_face_index(f->owner);
-	int ix_dest = carrier->find_face_index(t->owner);
+	int ix_orig = _faceindex(f->owner,carrier);
+	int ix_dest = _faceindex(t->owner,carrier);
 	data = 2 | (ix_orig << SIX0) | (ix_dest << SIX1 ) | (carrier->ID << SIXC);
       }
+      break;
     default:
       assert(0);
     }
   t->in.push_back(this);
   f->out.push_back(this);
-
-  arcs++;
 }
 
 /* ------------------------------------------------------ */
@@ -218,8 +253,15 @@ arc::arc ( node *f, node *t, arc *a ) :
 {
   t->in.push_back(this);
   f->out.push_back(this);
+}
+
+/* ------------------------------------------------------ */
 
-  arcs++;
+arc::arc ( node *f, node *t, unsigned int d ) :
+  from(f), to(t), data(d)
+{
+  t->in.push_back(this);
+  f->out.push_back(this);
 }
 
 /* ------------------------------------------------------ */
@@ -243,8 +285,6 @@ arc::~arc()
   assert(i<to->in.size());
   to->in[i] = to->in[to->in.size()-1];
   to->in.pop_back();
-
-  arcs--;
 }
 
 /* ------------------------------------------------------ */
@@ -315,6 +355,8 @@ void tgraph::remove_all_nonSCC()
 {
   int i,j;
 
+  pruned = true;
+
   for ( i=0; i<n.size(); )
     if (n[i] && n[i]->scc==-1)
       {
@@ -350,7 +392,44 @@ void tgraph::remove_all_nonSCC()
 
 /* ------------------------------------------------------ */
 
-tgraph::tgraph ( vfield_base *m ) : msh(m), mstp(NULL), sccs(-1), n()
+template<int D>
+void tgraph::_facequeries ( int i )
+{
+  mesh_element *cf = msh->getface(i);
+  const int m = D ? 2*D : cf->faces;  // number of boundary elements
+  for ( int j=0; j<m; j++ )
+    for ( int k=0; k<m; k++ )
+      {
+	// originally, only k==j was used (wrong!)
+	if ((k==j) || (k==(j+1)%m) || (k==(j+m-1)%m)) continue;
+	if (msh->attracts_flow(i,k) && msh->repels_flow(i,j))
+	  {
+	    cquery c = { i, j, k, 0, 1, 0, 1 };
+	    cq.push_back(c);
+	  }
+      }
+}
+
+/* ------------------------------------------------------ */
+
+tgraph::tgraph ( vfield_base *m ) : msh(m), mstp(NULL), sccs(-1), n(), pruned(false), 
+				   rtop(0), log(&cout), sdv(&tgraph::_subdivide<vfield_base>)
+{
+  _build(NULL,NULL);
+}
+
+/* ------------------------------------------------------ */
+
+tgraph::tgraph ( vfield_base *m, farcs *fa, const bool *changed ) : 
+  msh(m), mstp(NULL), sccs(-1), n(), pruned(false), rtop(0), log(&cout), sdv(&tgraph::_subdivide<vfield_base>)
+{
+  assert(fa);
+  _build(fa,changed);
+}
+
+/* ------------------------------------------------------ */
+
+void tgraph::_build ( farcs *fa, const bool *changed )
 {
   int i;
 
@@ -395,19 +474,60 @@ tgraph::tgraph ( vfield_base *m ) : msh(m), mstp(NULL), sccs(-1), n()
 	}
     }
 
+  // face arcs are tested in one batch, except for the faces whose arcs 
+  // are reused; either way, they are added in face order
+  bool reuse = fa && changed && fa->off.size()==msh->faces()+1;
+  cq.clear();
+  for ( i=0; i<msh->faces(); i++ )
+    if (!reuse || changed[i])
+      switch(msh->facedegree())
+	{
+	case 3:
+	  _facequeries<3>(i);
+	  break;
+	case 4:
+	  _facequeries<4>(i);
+	  break;
+	default:
+	  _facequeries<0>(i);
+	  break;
+	}
+  cr.resize(cq.size());
+  if (cq.size())
+    msh->connects_batch(cq.size(),&cq[0],&cr[0]);
+
+  farcs nfa;
+  int q = 0;
   for ( i=0; i<msh->faces(); i++ )
     {
       mesh_element *cf = msh->getface(i);
-      for ( int j=0; j<cf->faces; j++ )
-	for ( int k=0; k<cf->faces; k++ )
+      if (fa)
+	nfa.off.push_back(nfa.pr.size());
+      if (reuse && !changed[i])
+	{
+	  for ( int k=fa->off[i]; k<fa->off[i+1]; k++ )
+	    {
+	      int e1 = fa->pr[k] & 255;
+	      int e2 = fa->pr[k] >> 8;
+	      new arc(_getnode(cf->face[e1]),_getnode(cf->face[e2]),cf,e1,e2);
+	      nfa.pr.push_back(fa->pr[k]);
+	    }
+	  continue;
+	}
+      for ( ; q<cq.size() && cq[q].fce==i; q++ )
+	if (cr[q])
 	  {
-	    // originally, only k==j was used (wrong!)
-	    if ((k==j) || (k==(j+1)%cf->faces) || (k==(j+cf->faces-1)%cf->faces)) continue;
-	    if (msh->attracts_flow(i,k) && msh->repels_flow(i,j))
-	      if (msh->connects(i,j,k))
-		new arc(_getnode(cf->face[j]),_getnode(cf->face[k]),cf,j,k);
+	    new arc(_getnode(cf->face[cq[q].eix1]),_getnode(cf->face[cq[q].eix2]),cf,cq[q].eix1,cq[q].eix2);
+	    if (fa)
+	      nfa.pr.push_back(cq[q].eix1 | (cq[q].eix2 << 8));
 	  }
     }
+  if (fa)
+    {
+      nfa.off.push_back(nfa.pr.size());
+      fa->off.swap(nfa.off);
+      fa->pr.swap(nfa.pr);
+    }
 
   // we also need to add arcs from any isolated vertex to its incident edge and back
 
@@ -475,54 +595,29 @@ node * tgraph::merge ( int i, char side, bool move )
 	nn->lockR();      
     }
 
-  n[i]->flags |= (64|128);
-  n[j]->flags |= (64|128);
+  // targets and sources of the new node's arcs, so that parallel arcs are 
+  // not created; i and j are excluded
+  mrgo.reset(n.size());
+  mrgi.reset(n.size());
+  mrgo.set(i); mrgo.set(j);
+  mrgi.set(i); mrgi.set(j);
 
   int k;
   for ( k=0; k<n[i]->out.size(); k++ )
-    {
-      if (!(n[i]->out[k]->to->flags & 64))
-	{
-	  new arc(nn,n[i]->out[k]->to,n[i]->out[k]);
-	  n[i]->out[k]->to->flags |= 64;
-	}
-    }
+    if (!mrgo.testset(n[i]->out[k]->to->ID))
+      new arc(nn,n[i]->out[k]->to,n[i]->out[k]);
   for ( k=0; k<n[j]->out.size(); k++ )
-    {
-      if (!(n[j]->out[k]->to->flags & 64))
-	{
-	  new arc(nn,n[j]->out[k]->to,n[j]->out[k]);
-	  n[j]->out[k]->to->flags |= 64;
-	}
-    }
+    if (!mrgo.testset(n[j]->out[k]->to->ID))
+      new arc(nn,n[j]->out[k]->to,n[j]->out[k]);
   for ( k=0; k<n[i]->in.size(); k++ )
-    {
-      if (!(n[i]->in[k]->from->flags & 128))
-	{
-	  new arc(n[i]->in[k]->from,nn,n[i]->in[k]);
-	  n[i]->in[k]->from->flags |= 128;
-	}
-    }
+    if (!mrgi.testset(n[i]->in[k]->from->ID))
+      new arc(n[i]->in[k]->from,nn,n[i]->in[k]);
   for ( k=0; k<n[j]->in.size(); k++ )
-    {
-      if (!(n[j]->in[k]->from->flags & 128))
-	{
-	  new arc(n[j]->in[k]->from,nn,n[j]->in[k]);
-	  n[j]->in[k]->from->flags |= 128;
-	}
-    }
-
-  // clear flags now...
-  n[i]->flags &= ~(64|128);
-  n[j]->flags &= ~(64|128);
-  for ( k=0; k<nn->out.size(); k++ )
-    nn->out[k]->to->flags &= ~(64|128);
-  for ( k=0; k<nn->in.size(); k++ )
-    nn->in[k]->from->flags &= ~(64|128);
+    if (!mrgi.testset(n[j]->in[k]->from->ID))
+      new arc(n[j]->in[k]->from,nn,n[j]->in[k]);
 
   // set attributes of the new node
   nn->scc = n[i]->scc;
-  nn->flags |= n[i]->flags & (~(16|32|64|128));
 
   // delete old nodes
   n[i]->right = n[j]->right = n[i]->left = n[j]->left = NULL;
@@ -546,26 +641,96 @@ node * tgraph::merge ( int i, char side, bool move )
 
 /* ------------------------------------------------------ */
 
+// field calls made by the templated kernels: bound statically for a 
+// concrete field class VF, virtual for VF=vfield_base
+
+template<class VF>
+class _fieldcalls {
+ public:
+  static bool hasflowup ( vfield_base *m, int i ) 
+    { return ((VF*)m)->VF::hasflowup(i); }
+  static bool hasflowdown ( vfield_base *m, int i ) 
+    { return ((VF*)m)->VF::hasflowdown(i); }
+  static void connects_batch ( vfield_base *m, int cnt, const cquery *q, unsigned char *res )
+    { ((VF*)m)->VF::connects_batch(cnt,q,res); }
+};
+
+template<>
+class _fieldcalls<vfield_base> {
+ public:
+  static bool hasflowup ( vfield_base *m, int i ) 
+    { return m->hasflowup(i); }
+  static bool hasflowdown ( vfield_base *m, int i ) 
+    { return m->hasflowdown(i); }
+  static void connects_batch ( vfield_base *m, int cnt, const cquery *q, unsigned char *res )
+    { m->connects_batch(cnt,q,res); }
+};
+
+/* ------------------------------------------------------ */
+
 void tgraph::subdivide ( int i, double spt )
 {
+  (this->*sdv)(i,spt);
+}
+
+/* ------------------------------------------------------ */
+
+template<class VF>
+void tgraph::_subdivide ( int i, double spt )
+{
+  typedef _fieldcalls<VF> fc;
+
   if (!(n[i] && n[i]->isepiece()))
     return;
   double mid = n[i]->s+spt*(n[i]->e-n[i]->s);
   node *nl = new node(i,n[i]->owner,n[i]->left,NULL,n[i]->s,mid);
   node *nr = new node(n.size(),n[i]->owner,nl,n[i]->right,mid,n[i]->e);
   nl->right = nr;
+  nl->scc = nr->scc = n[i]->scc;  // keeps track of the SCC hierarchy
   if (n[i]->islockedL()) 
     nl->lockL();
   if (n[i]->islockedR())
     nr->lockR();
 
   // construct arcs now...
-  if (msh->hasflowup(n[i]->owner->ID))
+  if (fc::hasflowup(msh,n[i]->owner->ID))
     new arc(nl,nr,n[i]->owner);
-  if (msh->hasflowdown(n[i]->owner->ID))
+  if (fc::hasflowdown(msh,n[i]->owner->ID))
     new arc(nr,nl,n[i]->owner);
 
-  int j;
+  // face arcs: both halves are tested against the other end of every 
+  // face arc of n[i], all in one batch
+  int j,q;
+  cq.clear();
+  for ( j=0; j<n[i]->in.size(); j++ )
+    {
+      arc *a = n[i]->in[j];
+      if (a->get_dimension()!=2)
+	continue;
+      node *src = a->from;
+      cquery c = { a->get_ix(), a->get_ixf(), a->get_ixt(), src->s, src->e, nl->s, nl->e };
+      cq.push_back(c);
+      c.s2 = nr->s;
+      c.e2 = nr->e;
+      cq.push_back(c);
+    }
+  for ( j=0; j<n[i]->out.size(); j++ )
+    {
+      arc *a = n[i]->out[j];
+      if (a->get_dimension()!=2)
+	continue;
+      node *dst = a->to;
+      cquery c = { a->get_ix(), a->get_ixf(), a->get_ixt(), nl->s, nl->e, dst->s, dst->e };
+      cq.push_back(c);
+      c.s1 = nr->s;
+      c.e1 = nr->e;
+      cq.push_back(c);
+    }
+  cr.resize(cq.size());
+  if (cq.size())
+    fc::connects_batch(msh,cq.size(),&cq[0],&cr[0]);
+
+  q = 0;
   for ( j=0; j<n[i]->in.size(); j++ )
     {
       arc *a = n[i]->in[j];
@@ -604,18 +769,10 @@ void tgraph::subdivide ( int i, double spt )
 	  break;
 	case 2:
 	  {
-	    bool yes = false;
-	    if (msh->connects(a->get_ix(),a->get_ixf(),a->get_ixt(),src->s,src->e,nl->s,nl->e))
-	      {
-		new arc(src,nl,msh->getface(a->get_ix()),a->get_ixf(),a->get_ixt());
-		yes = true;
-	      }
-	    if (msh->connects(a->get_ix(),a->get_ixf(),a->get_ixt(),src->s,src->e,nr->s,nr->e))
-	      {
-		new arc(src,nr,msh->getface(a->get_ix()),a->get_ixf(),a->get_ixt());
-		yes = true;
-	      }
-	    //	    assert(yes);
+	    if (cr[q++])
+	      new arc(src,nl,msh->getface(a->get_ix()),a->get_ixf(),a->get_ixt());
+	    if (cr[q++])
+	      new arc(src,nr,msh->getface(a->get_ix()),a->get_ixf(),a->get_ixt());
 	  }
 	  break;
 	default:
@@ -662,18 +819,10 @@ void tgraph::subdivide ( int i, double spt )
 	  break;
 	case 2:
 	  {
-	    bool yes = false;
-	    if (msh->connects(a->get_ix(),a->get_ixf(),a->get_ixt(),nl->s,nl->e,dst->s,dst->e))
-	      {
-		new arc(nl,dst,msh->getface(a->get_ix()),a->get_ixf(),a->get_ixt());
-		yes = true;
-	      }
-	    if (msh->connects(a->get_ix(),a->get_ixf(),a->get_ixt(),nr->s,nr->e,dst->s,dst->e))
-	      {
-		new arc(nr,dst,msh->getface(a->get_ix()),a->get_ixf(),a->get_ixt());
-		yes = true;
-	      }
-	    //	    assert(yes);
+	    if (cr[q++])
+	      new arc(nl,dst,msh->getface(a->get_ix()),a->get_ixf(),a->get_ixt());
+	    if (cr[q++])
+	      new arc(nr,dst,msh->getface(a->get_ix()),a->get_ixf(),a->get_ixt());
 	  }
 	  break;
 	default:
@@ -698,6 +847,19 @@ void tgraph::subdivide ( int i, double spt )
 
 /* ------------------------------------------------------ */
 
+template<class VF>
+void tgraph::specialize()
+{
+  sdv = &tgraph::_subdivide<VF>;
+}
+
+template void tgraph::specialize<pcvf>();
+template void tgraph::specialize<pcstable>();
+template void tgraph::specialize<pchull>();
+template void tgraph::specialize<pcenv>();
+
+/* ------------------------------------------------------ */
+
 void tgraph::subdivide_all()
 {
   int num = n.size();
@@ -718,16 +880,112 @@ void tgraph::subdivide_scc_nodes()
 
 /* ------------------------------------------------------ */
 
+// upper estimate of memory growth caused by subdividing an edge piece:
+// one more node and at most deg+2 more arcs, each with two edge list entries
+// (counted twice for vector slack)
+
+static double _subdivision_cost ( int deg )
+{
+  return sizeof(node)+sizeof(node*)+(deg+2)*(sizeof(arc)+4*sizeof(arc*));
+}
+
+class sccpriority {
+ public:
+  int id;
+  bool ambiguous;
+  double span;
+  double cost;
+
+  bool operator< ( const sccpriority &o ) const
+  {
+    if (ambiguous!=o.ambiguous)
+      return ambiguous;
+    if (span!=o.span)
+      return span>o.span;
+    return id<o.id;
+  }
+};
+
+/* ------------------------------------------------------ */
+
+int tgraph::subdivide_scc_nodes ( double budget )
+{
+  int i;
+  int num = n.size();
+  double avail = budget-memory();
+
+  sccpriority *p = new sccpriority[sccs];
+  for ( i=0; i<sccs; i++ )
+    {
+      p[i].id = i;
+      p[i].span = p[i].cost = 0;
+    }
+
+  double total = 0;
+  for ( i=0; i<num; i++ )
+    if (n[i] && n[i]->scc>=0 && n[i]->isepiece())
+      {
+	double c = _subdivision_cost(n[i]->in.size()+n[i]->out.size());
+	p[n[i]->scc].cost += c;
+	p[n[i]->scc].span += n[i]->span();
+	total += c;
+      }
+
+  if (total<=avail)
+    {
+      delete[] p;
+      subdivide_scc_nodes();
+      return sccs;
+    }
+
+  // doesn't fit: pick SCCs by priority
+  computeMSTypes();
+  for ( i=0; i<sccs; i++ )
+    p[i].ambiguous = !(mstp[i].issink() || mstp[i].issource() || mstp[i].issaddle() ||
+		       mstp[i].isapo() || mstp[i].isrpo());
+  sort(p,p+sccs);
+
+  bool *sel = new bool[sccs];
+  int res = 0;
+  for ( i=0; i<sccs; i++ )
+    sel[i] = false;
+  for ( i=0; i<sccs; i++ )
+    if (p[i].cost>0 && p[i].cost<=avail)
+      {
+	sel[p[i].id] = true;
+	avail -= p[i].cost;
+	res++;
+      }
+
+  for ( i=0; i<num; i++ )
+    if (n[i] && n[i]->scc>=0 && sel[n[i]->scc])
+      subdivide(i);
+
+  delete[] sel;
+  delete[] p;
+  return res;
+}
+
+/* ------------------------------------------------------ */
+
 int tgraph::nodes()
 {
-  return node::nodes;
+  int res = 0;
+  for ( int i=0; i<n.size(); i++ )
+    if (n[i])
+      res++;
+  return res;
 }
 
 /* ------------------------------------------------------ */
 
 int tgraph::arcs()
 {
-  return arc::arcs;
+  int res = 0;
+  for ( int i=0; i<n.size(); i++ )
+    if (n[i])
+      res += n[i]->out.size();
+  return res;
 }
 
 /* ------------------------------------------------------ */
@@ -747,6 +1005,12 @@ int tgraph::arcs2()
 void tgraph::computeSCCs()
 {
   int i;
+
+  // remember the old labeling for the hierarchy
+  int *old = new int[n.size()];
+  for ( i=0; i<n.size(); i++ )
+    old[i] = n[i] ? n[i]->scc : -1;
+
   for ( i=0; i<n.size(); i++ )
     if (n[i]) n[i]->scc = 0;
 
@@ -785,6 +1049,14 @@ void tgraph::computeSCCs()
 
   delete[] nv;
   sccs = curid;
+
+  // refinement can only split SCCs, so any node of a new SCC gives its parent
+  hier.push_back(vector<int>(sccs,-1));
+  vector<int> &par = hier.back();
+  for ( i=0; i<n.size(); i++ )
+    if (n[i] && n[i]->scc>=0 && hier.size()>1)
+      par[n[i]->scc] = old[i];
+  delete[] old;
 }
 
 /* ------------------------------------------------------ */
@@ -832,54 +1104,43 @@ int tgraph::SCCs()
 
 /* ------------------------------------------------------ */
 
-void tgraph::computeMSTypes()
+int tgraph::levels()
 {
-  int i,j;
-
-  if (mstp) delete[] mstp;
+  return hier.size();
+}
 
-  if (sccs==0)
-    {
-      mstp = NULL;
-      return;
-    }
+/* ------------------------------------------------------ */
 
-  mstp = new mstype[sccs];
-  for ( i=0; i<n.size(); i++ )
-    if (n[i] && n[i]->scc>=0)
-      {
-	mstp[n[i]->scc].incsize();
+int tgraph::SCCs ( int level )
+{
+  assert(level>=0 && level<hier.size());
+  return hier[level].size();
+}
 
-	if (n[i]->owner->dimension==0)
-	  {
-	    mstp[n[i]->scc].addtoindex(msh->index(n[i]->owner->ID));
-	    mstp[n[i]->scc].addtoindex2(msh->index2(n[i]->owner->ID));
-	    if (n[i]->owner->isboundary())
-	      mstp[n[i]->scc].setbdry();
-	  }
+/* ------------------------------------------------------ */
 
-	for ( j=0; j<n[i]->in.size(); j++ )
-	  if (n[i]->in[j]->from->scc!=n[i]->scc)
-	    mstp[n[i]->scc].orstability(1);
-	for ( j=0; j<n[i]->out.size(); j++ )
-	  if (n[i]->out[j]->to->scc!=n[i]->scc)
-	    mstp[n[i]->scc].orstability(2);
-      }
+int tgraph::SCCparent ( int level, int i )
+{
+  assert(level>0 && level<hier.size());
+  assert(i>=0 && i<hier[level].size());
+  return hier[level][i];
 }
 
 /* ------------------------------------------------------ */
 
-mstype tgraph::MStype ( int i )
+int tgraph::SCCancestor ( int i, int level )
 {
-  return mstp[i];
+  assert(level>=0 && level<hier.size());
+  for ( int l=hier.size()-1; l>level && i>=0; l-- )
+    i = hier[l][i];
+  return i;
 }
 
 /* ------------------------------------------------------ */
 
-void tgraph::saveSeparatrices ( const char *name )
+void tgraph::saveSCCtree ( const char *name )
 {
-  int i,j;
-  ofstream ofs(name,ios::binary);
+  ofstream ofs(name);
 
   if (!ofs)
     {
@@ -887,44 +1148,503 @@ void tgraph::saveSeparatrices ( const char *name )
       return;
     }
 
-  mark();
+  ofs << hier.size() << endl;
+  for ( int l=0; l<hier.size(); l++ )
+    {
+      ofs << hier[l].size();
+      for ( int i=0; i<hier[l].size(); i++ )
+	ofs << " " << hier[l][i];
+      ofs << endl;
+    }
+}
 
-  // start with vertices
-  for ( i=0; i<n.size(); i++ )
+/* ------------------------------------------------------ */
+
+// same rules as the constructor and subdivide use to create the arc
+
+bool tgraph::_infield ( arc *a, vfield_base *f )
+{
+  node *fr = a->from;
+  node *to = a->to;
+  if (a->get_dimension()==0)
+    return f->isstationary(a->get_ix());
+
+  assert(a->get_dimension()==1);
+  mesh_element *c = msh->getedge(a->get_ix());
+  bool up;
+  if (fr->owner->dimension==0 || to->owner->dimension==0)
     {
-      if (!n[i] || !(n[i]->flags & (1|2)))
-	continue;
+      // vertex to edge piece or back; these are also there for spiral vertices
+      node *vn = fr->owner->dimension==0 ? fr : to;
+      if (f->isspiral(vn->owner->ID) && vn->owner->coface[0]==c)
+	return true;
+      up = (fr->owner==c->face[0] || to->owner==c->face[1]);
+    }
+  else
+    up = (fr->e==to->s);
+  return up ? f->hasflowup(c->ID) : f->hasflowdown(c->ID);
+}
 
-      if (n[i]->owner->dimension==0 && n[i]->scc==-1)
-	;
-	//	primitive(0,0,0,255,false,
-	//  msh->vertex(n[i]->owner->ID)).save(ofs);
-      else
-	if (n[i]->owner->dimension==1 && n[i]->scc==-1)
-	  primitive(0,0,0,255,false,
-		    msh->edgepoint(n[i]->owner->ID,n[i]->s),
-		    msh->edgepoint(n[i]->owner->ID,n[i]->e)).save(ofs);
+/* ------------------------------------------------------ */
 
-      for ( j=0; j<n[i]->out.size(); j++ )
+// strongly connected components of the graph with nodes 0..N-1 and arcs 
+// to[off[i]..off[i+1]-1] out of node i; comp gets the component of each 
+// node, the count is returned (iterative Tarjan)
+
+static int _tarjan ( int N, const vector<int> &off, const vector<int> &to, vector<int> &comp )
+{
+  vector<int> idx(N,-1),low(N),stk,dfs,pos(N);
+  vector<char> onstk(N,0);
+  int index = 0, cnt = 0;
+
+  comp.assign(N,-1);
+  for ( int s=0; s<N; s++ )
+    {
+      if (idx[s]>=0)
+	continue;
+      dfs.push_back(s);
+      idx[s] = low[s] = index++;
+      pos[s] = off[s];
+      stk.push_back(s);
+      onstk[s] = 1;
+      while (dfs.size())
 	{
-	  arc *a = n[i]->out[j];
-	  if (a->from->scc>=0 && a->from->scc==a->to->scc)
-	    continue;
-	  if (!(a->from->flags & a->to->flags & (1|2)))
-	    continue;
-	  if (a->get_dimension()<2)
-	    continue;
+	  int v = dfs.back();
+	  if (pos[v]<off[v+1])
+	    {
+	      int w = to[pos[v]++];
+	      if (idx[w]<0)
+		{
+		  idx[w] = low[w] = index++;
+		  pos[w] = off[w];
+		  stk.push_back(w);
+		  onstk[w] = 1;
+		  dfs.push_back(w);
+		}
+	      else
+		if (onstk[w] && idx[w]<low[v])
+		  low[v] = idx[w];
+	      continue;
+	    }
+	  dfs.pop_back();
+	  if (dfs.size() && low[v]<low[dfs.back()])
+	    low[dfs.back()] = low[v];
+	  if (low[v]==idx[v])
+	    {
+	      int w;
+	      do {
+		w = stk.back();
+		stk.pop_back();
+		onstk[w] = 0;
+		comp[w] = cnt;
+	      } while (w!=v);
+	      cnt++;
+	    }
+	}
+    }
+  return cnt;
+}
+
+/* ------------------------------------------------------ */
+
+// a pair of ranges of pieces is split only if f connects their spans, 
+// so this takes time proportional to the number of pairs found
+
+void tgraph::_connected ( vfield_base *f, int fce, int ea, node **a, int na, int eb, node **b, int nb,
+			 vector<int> &ps, vector<int> &pd )
+{
+  if (!f->connects(fce,ea,eb,a[0]->s,a[na-1]->e,b[0]->s,b[nb-1]->e))
+    return;
+  if (na==1 && nb==1)
+    {
+      ps.push_back(a[0]->ID);
+      pd.push_back(b[0]->ID);
+      return;
+    }
+  if (na>=nb)
+    {
+      _connected(f,fce,ea,a,na/2,eb,b,nb,ps,pd);
+      _connected(f,fce,ea,a+na/2,na-na/2,eb,b,nb,ps,pd);
+    }
+  else
+    {
+      _connected(f,fce,ea,a,na,eb,b,nb/2,ps,pd);
+      _connected(f,fce,ea,a,na,eb,b+nb/2,nb-nb/2,ps,pd);
+    }
+}
+
+/* ------------------------------------------------------ */
+
+// Morse sets for smaller radii are inside the ones for larger radii, so 
+// the levels are computed in turn, each from the arcs inside a Morse set 
+// of the previous one only; they get fewer fast. Faces stationary for msh
+// have no arcs across them, but they can have them at later levels: these
+// are added at the first level the face is not stationary at.
+
+void tgraph::computeRadiusTree ( const vector<vfield_base*> &f )
+{
+  int i,j,k,l;
+  const int N = n.size();
+  const int K = f.size()+1;
+  const int chunk = 4096;  // connects_batch queries per thread
+
+  assert(sccs>=0);
+
+  // Morse set of each node at the current level (-1 if none)
+  vector<int> lab(N,-1);
+  for ( i=0; i<N; i++ )
+    if (n[i])
+      {
+	assert(n[i]->ID==i);
+	lab[i] = n[i]->scc;
+      }
+  rhier.assign(1,vector<int>(sccs,-1));
+
+  // arcs of the current graph inside Morse sets, and arcs across faces 
+  // stationary for msh added so far (node pairs and their face query)
+  vector<arc*> A;
+  for ( i=0; i<N; i++ )
+    if (n[i] && lab[i]>=0)
+      for ( j=0; j<n[i]->out.size(); j++ )
+	if (lab[n[i]->out[j]->to->ID]==lab[i])
+	  A.push_back(n[i]->out[j]);
+  vector<int> xs,xd;
+  vector<cquery> xq;
+
+  // the level each face stationary for msh stops being stationary at 
+  // (K if never), and the nodes on its boundary in Morse sets
+  vector<int> first(msh->faces(),K);
+  vector<vector<int> > bnd(msh->faces());
+  for ( i=0; i<msh->faces(); i++ )
+    if (msh->iststationary(i))
+      for ( l=1; l<K && first[i]==K; l++ )
+	if (!f[l-1]->iststationary(i))
+	  first[i] = l;
+  for ( i=0; i<N; i++ )
+    if (n[i] && lab[i]>=0)
+      {
+	mesh_element *o = n[i]->owner;
+	int k0 = o->dimension ? 0 : 1;  // vertex cofaces: edges and faces in turn
+	for ( k=k0; k<o->cofaces; k+=k0+1 )
+	  if (first[o->coface[k]->ID]<K)
+	    bnd[o->coface[k]->ID].push_back(i);
+      }
+
+  for ( l=1; l<K; l++ )
+    {
+      vfield_base *fl = f[l-1];
+
+      // arcs of the graph: non face arcs are tested one by one, face arcs
+      // in one batch, with the test of the face sides the constructor makes
+      vector<char> keep(A.size());
+      vector<int> fa;
+      cq.clear();
+      for ( j=0; j<A.size(); j++ )
+	{
+	  arc *a = A[j];
+	  if (a->get_dimension()!=2)
+	    {
+	      keep[j] = _infield(a,fl);
+	      continue;
+	    }
+	  keep[j] = 0;
+	  if (!fl->attracts_flow(a->get_ix(),a->get_ixt()) || !fl->repels_flow(a->get_ix(),a->get_ixf()))
+	    continue;
+	  cquery c = { a->get_ix(), a->get_ixf(), a->get_ixt(), a->from->s, a->from->e, a->to->s, a->to->e };
+	  cq.push_back(c);
+	  fa.push_back(j);
+	}
+      vector<int> xa;
+      for ( j=0; j<xq.size(); j++ )
+	if (fl->attracts_flow(xq[j].fce,xq[j].eix2) && fl->repels_flow(xq[j].fce,xq[j].eix1))
+	  {
+	    cq.push_back(xq[j]);
+	    xa.push_back(j);
+	  }
+      cr.resize(cq.size());
+      parallel_for((cq.size()+chunk-1)/chunk,[&]( int c, int )
+		   {
+		     int b = c*chunk;
+		     fl->connects_batch(min(chunk,(int)cq.size()-b),&cq[b],&cr[b]);
+		   });
+      for ( j=0; j<fa.size(); j++ )
+	keep[fa[j]] = cr[j];
+
+      vector<arc*> nA;
+      for ( j=0; j<A.size(); j++ )
+	if (keep[j])
+	  nA.push_back(A[j]);
+      A.swap(nA);
+      vector<int> nxs,nxd;
+      vector<cquery> nxq;
+      for ( j=0; j<xa.size(); j++ )
+	if (cr[fa.size()+j])
+	  {
+	    nxs.push_back(xs[xa[j]]);
+	    nxd.push_back(xd[xa[j]]);
+	    nxq.push_back(xq[xa[j]]);
+	  }
+
+      // arcs across the faces that are not stationary from this level on,
+      // between pieces of the same Morse set
+      vector<int> fcs;
+      for ( i=0; i<msh->faces(); i++ )
+	if (first[i]==l)
+	  fcs.push_back(i);
+      vector<vector<int> > ps(fcs.size()),pd(fcs.size());
+      parallel_for(fcs.size(),[&]( int q, int )
+		   {
+		     int fc = fcs[q];
+		     mesh_element *cf = msh->getface(fc);
+		     const int m = cf->faces;
+		     vector<vector<node*> > el(m);
+		     for ( int b=0; b<bnd[fc].size(); b++ )
+		       {
+			 node *x = n[bnd[fc][b]];
+			 el[_faceindex(x->owner,cf)].push_back(x);
+		       }
+		     for ( int e=0; e<m; e++ )
+		       sort(el[e].begin(),el[e].end(),[]( node *x, node *y ) { return x->s<y->s; });
+		     for ( int ea=0; ea<m; ea++ )
+		       for ( int eb=0; eb<m; eb++ )
+			 {
+			   if ((ea==eb) || (eb==(ea+1)%m) || (eb==(ea+m-1)%m)) continue;
+			   if (!el[ea].size() || !el[eb].size()) continue;
+			   if (!fl->attracts_flow(fc,eb) || !fl->repels_flow(fc,ea)) continue;
+			   _connected(fl,fc,ea,&el[ea][0],el[ea].size(),eb,&el[eb][0],el[eb].size(),ps[q],pd[q]);
+			 }
+		   });
+      for ( j=0; j<fcs.size(); j++ )
+	{
+	  mesh_element *cf = msh->getface(fcs[j]);
+	  for ( k=0; k<ps[j].size(); k++ )
+	    {
+	      node *a = n[ps[j][k]];
+	      node *b = n[pd[j][k]];
+	      if (lab[a->ID]!=lab[b->ID])
+		continue;
+	      cquery c = { fcs[j], _faceindex(a->owner,cf), _faceindex(b->owner,cf), a->s, a->e, b->s, b->e };
+	      nxs.push_back(a->ID);
+	      nxd.push_back(b->ID);
+	      nxq.push_back(c);
+	    }
+	  vector<int>().swap(bnd[fcs[j]]);
+	}
+
+      // SCCs of the nodes in Morse sets of the previous level
+      vector<int> off(N+1,0),to;
+      for ( j=0; j<A.size(); j++ )
+	off[A[j]->from->ID+1]++;
+      for ( j=0; j<nxs.size(); j++ )
+	off[nxs[j]+1]++;
+      for ( i=0; i<N; i++ )
+	off[i+1] += off[i];
+      to.resize(off[N]);
+      {
+	vector<int> p(off.begin(),off.end()-1);
+	for ( j=0; j<A.size(); j++ )
+	  to[p[A[j]->from->ID]++] = A[j]->to->ID;
+	for ( j=0; j<nxs.size(); j++ )
+	  to[p[nxs[j]]++] = nxd[j];
+      }
+      vector<int> comp,size;
+      int nc = _tarjan(N,off,to,comp);
+      size.assign(nc,0);
+      for ( i=0; i<N; i++ )
+	if (lab[i]>=0)
+	  size[comp[i]]++;
+
+      // Morse sets: components of more than one node or a stationary 
+      // vertex, as in computeSCCs
+      vector<int> cid(nc,-1);
+      vector<int> par;
+      for ( i=0; i<N; i++ )
+	{
+	  if (lab[i]<0)
+	    continue;
+	  int c = comp[i];
+	  if (cid[c]<0 && (size[c]>1 || (n[i]->owner->dimension==0 && msh->isstationary(n[i]->owner->ID))))
+	    {
+	      cid[c] = par.size();
+	      par.push_back(lab[i]);
+	    }
+	  lab[i] = cid[c];
+	}
+      rhier.push_back(par);
+
+      // only arcs inside the new Morse sets are needed from now on
+      nA.clear();
+      for ( j=0; j<A.size(); j++ )
+	if (lab[A[j]->from->ID]>=0 && lab[A[j]->from->ID]==lab[A[j]->to->ID])
+	  nA.push_back(A[j]);
+      A.swap(nA);
+      xs.clear();
+      xd.clear();
+      xq.clear();
+      for ( j=0; j<nxs.size(); j++ )
+	if (lab[nxs[j]]>=0 && lab[nxs[j]]==lab[nxd[j]])
+	  {
+	    xs.push_back(nxs[j]);
+	    xd.push_back(nxd[j]);
+	    xq.push_back(nxq[j]);
+	  }
+    }
+
+  rtop = hier.size();
+}
+
+/* ------------------------------------------------------ */
+
+int tgraph::radiusLevels()
+{
+  return rhier.size();
+}
+
+/* ------------------------------------------------------ */
+
+int tgraph::radiusSCCs ( int level )
+{
+  assert(level>=0 && level<rhier.size());
+  return rhier[level].size();
+}
+
+/* ------------------------------------------------------ */
+
+void tgraph::saveRadiusTree ( const char *name )
+{
+  ofstream ofs(name);
+
+  if (!ofs)
+    {
+      cout << "Can't open file " << name << " for writing the output..." << endl;
+      return;
+    }
+
+  // level 0 refers to the SCCs at the time of computeRadiusTree; if SCCs 
+  // were computed again since (e.g. after coarsenMorseSets), the parents 
+  // at level 1 are translated to the current IDs
+  vector<int> cur(rhier.size() ? rhier[0].size() : 0);
+  for ( int i=0; i<cur.size(); i++ )
+    cur[i] = i;
+  if (rhier.size() && hier.size()>rtop)
+    {
+      cur.assign(rhier[0].size(),-1);
+      for ( int i=0; i<sccs; i++ )
+	cur[SCCancestor(i,rtop-1)] = i;
+    }
+
+  ofs << rhier.size() << endl;
+  for ( int l=0; l<rhier.size(); l++ )
+    {
+      ofs << rhier[l].size();
+      for ( int i=0; i<rhier[l].size(); i++ )
+	ofs << " " << (l==1 ? cur[rhier[l][i]] : rhier[l][i]);
+      ofs << endl;
+    }
+}
+
+/* ------------------------------------------------------ */
+
+void tgraph::computeMSTypes()
+{
+  int i,j;
+
+  if (mstp) delete[] mstp;
+
+  if (sccs==0)
+    {
+      mstp = NULL;
+      return;
+    }
+
+  mstp = new mstype[sccs];
+  for ( i=0; i<n.size(); i++ )
+    if (n[i] && n[i]->scc>=0)
+      {
+	mstp[n[i]->scc].incsize();
+
+	if (n[i]->owner->dimension==0)
+	  {
+	    mstp[n[i]->scc].addtoindex(msh->index(n[i]->owner->ID));
+	    mstp[n[i]->scc].addtoindex2(msh->index2(n[i]->owner->ID));
+	    if (n[i]->owner->isboundary())
+	      mstp[n[i]->scc].setbdry();
+	  }
+
+	for ( j=0; j<n[i]->in.size(); j++ )
+	  if (n[i]->in[j]->from->scc!=n[i]->scc)
+	    mstp[n[i]->scc].orstability(1);
+	for ( j=0; j<n[i]->out.size(); j++ )
+	  if (n[i]->out[j]->to->scc!=n[i]->scc)
+	    mstp[n[i]->scc].orstability(2);
+      }
+}
+
+/* ------------------------------------------------------ */
+
+mstype tgraph::MStype ( int i )
+{
+  return mstp[i];
+}
+
+/* ------------------------------------------------------ */
+
+bool tgraph::_inregion ( int i, bool both )
+{
+  return both ? fwd.test(i) && bwd.test(i) : fwd.test(i) || bwd.test(i);
+}
+
+/* ------------------------------------------------------ */
+
+void tgraph::_saveregion ( const char *name, bool both )
+{
+  int i,j;
+  ofstream ofs(name,ios::binary);
+
+  if (!ofs)
+    {
+      cout << "Can't open file " << name << " for writing the output..." << endl;
+      return;
+    }
+
+  // start with vertices
+  for ( i=0; i<n.size(); i++ )
+    {
+      if (!n[i] || !_inregion(i,both))
+	continue;
+
+      if (n[i]->owner->dimension==0 && n[i]->scc==-1)
+	;
+	//	primitive(0,0,0,255,false,
+	//  msh->vertex(n[i]->owner->ID)).save(ofs);
+      else
+	if (n[i]->owner->dimension==1 && n[i]->scc==-1)
+	  primitive(0,0,0,255,false,
+		    msh->edgepoint(n[i]->owner->ID,n[i]->s),
+		    msh->edgepoint(n[i]->owner->ID,n[i]->e)).save(ofs);
+
+      for ( j=0; j<n[i]->out.size(); j++ )
+	{
+	  arc *a = n[i]->out[j];
+	  if (a->from->scc>=0 && a->from->scc==a->to->scc)
+	    continue;
+	  if (both ? !_inregion(a->from->ID,true) || !_inregion(a->to->ID,true) :
+	      !(fwd.test(a->from->ID) && fwd.test(a->to->ID)) && 
+	      !(bwd.test(a->from->ID) && bwd.test(a->to->ID)))
+	    continue;
+	  if (a->get_dimension()<2)
+	    continue;
 	  if (a->from->owner->dimension==0 && a->to->owner->dimension==0)
 	    primitive(0,0,0,255,false,
-		      msh->vertex(a->from->owner->ID),
-		      msh->vertex(a->to->owner->ID)).save(ofs);
+		      msh->facepoint(a->get_ix(),a->get_ixf()),
+		      msh->facepoint(a->get_ix(),a->get_ixt())).save(ofs);
 	  else
 	    if (a->from->owner->dimension==1 && a->to->owner->dimension==0)
 	      {
 		primitive p(0,0,0,255,false,
-			    msh->edgepoint(a->from->owner->ID,a->from->s),
-			    msh->edgepoint(a->from->owner->ID,a->from->e),
-			    msh->vertex(a->to->owner->ID));
+			    msh->facepoint(a->get_ix(),a->get_ixf(),a->from->s),
+			    msh->facepoint(a->get_ix(),a->get_ixf(),a->from->e),
+			    msh->facepoint(a->get_ix(),a->get_ixt()));
 		p.orient(msh->normal(a->get_ix()));
 		p.save(ofs);
 	      }
@@ -932,9 +1652,9 @@ void tgraph::saveSeparatrices ( const char *name )
 	      if (a->from->owner->dimension==0 && a->to->owner->dimension==1)
 		{
 		  primitive p(0,0,0,255,false,
-			      msh->edgepoint(a->to->owner->ID,a->to->s),
-			      msh->edgepoint(a->to->owner->ID,a->to->e),
-			      msh->vertex(a->from->owner->ID));
+			      msh->facepoint(a->get_ix(),a->get_ixt(),a->to->s),
+			      msh->facepoint(a->get_ix(),a->get_ixt(),a->to->e),
+			      msh->facepoint(a->get_ix(),a->get_ixf()));
 		  p.orient(msh->normal(a->get_ix()));
 		  p.save(ofs);
 		}
@@ -942,10 +1662,10 @@ void tgraph::saveSeparatrices ( const char *name )
 		if (a->from->owner->dimension==1 && a->to->owner->dimension==1)
 		  {
 		    primitive p(0,0,0,255,false,
-				msh->edgepoint(a->to->owner->ID,a->to->s),
-				msh->edgepoint(a->to->owner->ID,a->to->e),
-				msh->edgepoint(a->from->owner->ID,a->from->s),
-				msh->edgepoint(a->from->owner->ID,a->from->e));
+				msh->facepoint(a->get_ix(),a->get_ixt(),a->to->s),
+				msh->facepoint(a->get_ix(),a->get_ixt(),a->to->e),
+				msh->facepoint(a->get_ix(),a->get_ixf(),a->from->s),
+				msh->facepoint(a->get_ix(),a->get_ixf(),a->from->e));
 		    p.orient(msh->normal(a->get_ix()));
 		    p.save(ofs);		
 		  }
@@ -957,6 +1677,14 @@ void tgraph::saveSeparatrices ( const char *name )
 
 /* ------------------------------------------------------ */
 
+void tgraph::saveSeparatrices ( const char *name )
+{
+  mark();
+  _saveregion(name,false);
+}
+
+/* ------------------------------------------------------ */
+
 void tgraph::saveMorseSets ( const char *name )
 {
   int i,j;
@@ -1023,8 +1751,8 @@ void tgraph::saveMorseSets ( const char *name )
 	      primitive(n[i]->scc,
 			mstp[n[i]->scc].getindex(), mstp[n[i]->scc].getindex2(),
 			mstp[n[i]->scc].getstability(), mstp[n[i]->scc].getbdry(),
-			msh->vertex(a->from->owner->ID),
-			msh->vertex(a->to->owner->ID)).save(ofs);
+			msh->facepoint(a->get_ix(),a->get_ixf()),
+			msh->facepoint(a->get_ix(),a->get_ixt())).save(ofs);
 	    }
 	  else
 	    if (a->from->owner->dimension==1 && a->to->owner->dimension==0)
@@ -1032,9 +1760,9 @@ void tgraph::saveMorseSets ( const char *name )
 		primitive p(n[i]->scc,
 			    mstp[n[i]->scc].getindex(), mstp[n[i]->scc].getindex2(),
 			    mstp[n[i]->scc].getstability(), mstp[n[i]->scc].getbdry(),
-			    msh->edgepoint(a->from->owner->ID,a->from->s),
-			    msh->edgepoint(a->from->owner->ID,a->from->e),
-			    msh->vertex(a->to->owner->ID));
+			    msh->facepoint(a->get_ix(),a->get_ixf(),a->from->s),
+			    msh->facepoint(a->get_ix(),a->get_ixf(),a->from->e),
+			    msh->facepoint(a->get_ix(),a->get_ixt()));
 		p.orient(msh->normal(a->get_ix()));
 		p.save(ofs);
 	      }
@@ -1044,9 +1772,9 @@ void tgraph::saveMorseSets ( const char *name )
 		  primitive p(n[i]->scc,
 			      mstp[n[i]->scc].getindex(), mstp[n[i]->scc].getindex2(),
 			      mstp[n[i]->scc].getstability(), mstp[n[i]->scc].getbdry(),
-			      msh->edgepoint(a->to->owner->ID,a->to->s),
-			      msh->edgepoint(a->to->owner->ID,a->to->e),
-			      msh->vertex(a->from->owner->ID));
+			      msh->facepoint(a->get_ix(),a->get_ixt(),a->to->s),
+			      msh->facepoint(a->get_ix(),a->get_ixt(),a->to->e),
+			      msh->facepoint(a->get_ix(),a->get_ixf()));
 		  p.orient(msh->normal(a->get_ix()));
 		  p.save(ofs);
 		}
@@ -1056,10 +1784,10 @@ void tgraph::saveMorseSets ( const char *name )
 		    primitive p(n[i]->scc,
 				mstp[n[i]->scc].getindex(), mstp[n[i]->scc].getindex2(),
 				mstp[n[i]->scc].getstability(), mstp[n[i]->scc].getbdry(),
-				msh->edgepoint(a->to->owner->ID,a->to->s),
-				msh->edgepoint(a->to->owner->ID,a->to->e),
-				msh->edgepoint(a->from->owner->ID,a->from->s),
-				msh->edgepoint(a->from->owner->ID,a->from->e));
+				msh->facepoint(a->get_ix(),a->get_ixt(),a->to->s),
+				msh->facepoint(a->get_ix(),a->get_ixt(),a->to->e),
+				msh->facepoint(a->get_ix(),a->get_ixf(),a->from->s),
+				msh->facepoint(a->get_ix(),a->get_ixf(),a->from->e));
 		    p.orient(msh->normal(a->get_ix()));
       		    p.save(ofs);		    
 		  }
@@ -1073,29 +1801,109 @@ void tgraph::saveMorseSets ( const char *name )
 
 /* ------------------------------------------------------ */
 
-void tgraph::clear_flags()
+void tgraph::_sweep ( vector<node*> &seeds, char dir, nodemark &m )
 {
-  for ( int i=0; i<n.size(); i++ )
-    if (n[i])
-      n[i]->flags &= (16|32);
+  int j;
+
+  m.reset(n.size());
+  frontier.clear();
+  for ( j=0; j<seeds.size(); j++ )
+    if (!m.testset(seeds[j]->ID))
+      frontier.push_back(seeds[j]);
+
+  while (!frontier.empty())
+    {
+      node *c = frontier.back();
+      frontier.pop_back();
+      if (dir=='f')
+	{
+	  for ( j=0; j<c->out.size(); j++ )
+	    if (!m.testset(c->out[j]->to->ID))
+	      frontier.push_back(c->out[j]->to);
+	}
+      else
+	for ( j=0; j<c->in.size(); j++ )
+	  if (!m.testset(c->in[j]->from->ID))
+	    frontier.push_back(c->in[j]->from);
+    }
 }
 
 /* ------------------------------------------------------ */
 
 void tgraph::mark()
 {
-  int i;
+  vector<node*> seeds;
 
-  clear_flags();
-  
-  for ( i=0; i<n.size(); i++ )
+  // one forward and one backward sweep, both seeded with all nodes of 
+  // saddle-type Morse sets
+  for ( int i=0; i<n.size(); i++ )
     if (n[i] && n[i]->scc>=0 && 
 	!mstp[n[i]->scc].istrivial() && 
 	!mstp[n[i]->scc].isattracting() && !mstp[n[i]->scc].isrepelling())
-      {
-	n[i]->markf(1);
-	n[i]->markb(2);
-      }
+      seeds.push_back(n[i]);
+
+  _sweep(seeds,'f',fwd);
+  _sweep(seeds,'b',bwd);
+}
+
+/* ------------------------------------------------------ */
+
+bool tgraph::connection ( int a, int b, int level )
+{
+  int i;
+  double span = 1.01/(1<<level);
+  vector<node*> sa,sb;
+
+  if (a==b)
+    {
+      cout << "connection: the two Morse sets have to differ" << endl;
+      exit(1);
+    }
+
+  // Morse set nodes are not subdivided below, so these stay valid
+  for ( i=0; i<n.size(); i++ )
+    {
+      if (!n[i])
+	continue;
+      if (n[i]->scc==a)
+	sa.push_back(n[i]);
+      if (n[i]->scc==b)
+	sb.push_back(n[i]);
+    }
+
+  *log << "Refining connection region: " << flush;
+
+  while(1)
+    {
+      _sweep(sa,'f',fwd);
+      _sweep(sb,'b',bwd);
+
+      // subdivide appends the right half, so the IDs collected stay valid
+      vector<int> tbs;
+      for ( i=0; i<n.size(); i++ )
+	if (n[i] && fwd.test(i) && bwd.test(i) && n[i]->isepiece() && 
+	    n[i]->scc==-1 && n[i]->span()>span)
+	  tbs.push_back(i);
+      if (!tbs.size())
+	break;
+      for ( i=0; i<tbs.size(); i++ )
+	subdivide(tbs[i]);
+      *log << "." << flush;
+    }
+
+  *log << endl;
+
+  for ( i=0; i<n.size(); i++ )
+    if (_inregion(i,true))
+      return true;
+  return false;
+}
+
+/* ------------------------------------------------------ */
+
+void tgraph::saveConnection ( const char *name )
+{
+  _saveregion(name,true);
 }
 
 /* ------------------------------------------------------ */
@@ -1113,16 +1921,22 @@ void tgraph::traverse_and_subdivide ( int start, int minlevel, int maxlevel, cha
 
   // NOTE: can probably just do phase 1 for backward traversals
 
+  // trv marks the nodes traversed in the current round, nsub the pieces
+  // subdivided in it; a piece is never subdivided after it was traversed 
+  // in the same round, so both halves start out unmarked in trv
+
   while(1)
     {
       traversed.clear();
       found = false;
+      trv.reset(n.size());
+      nsub.reset(n.size());
 
       stack<node*> S;
       S.push(startnode);
-      n[startnode->ID]->flags |= 1;
+      trv.set(startnode->ID);
 
-      vector<node*> newnodes;
+      bool newnodes = false;
 
       while (!S.empty())
 	{
@@ -1135,44 +1949,37 @@ void tgraph::traverse_and_subdivide ( int start, int minlevel, int maxlevel, cha
 
 	  traversed.push_back(cn);	
 	  
+	  vector<arc*> &a = (dir=='f') ? cn->out : cn->in;
 	  vector<node*> toBsubdivided;
-	  for ( i=0; i<((dir=='f') ? cn->out : cn->in).size(); i++ )
-	    if (((dir=='f') ? cn->out[i]->to : cn->in[i]->from)->isepiece() && 
-		((dir=='f') ? cn->out[i]->to : cn->in[i]->from)->scc==-1 && 
-		((dir=='f') ? cn->out[i]->to : cn->in[i]->from)->span()>cspan && 
-		!(((dir=='f') ? cn->out[i]->to : cn->in[i]->from)->flags&2))
-	      {
-		toBsubdivided.push_back((dir=='f') ? cn->out[i]->to : cn->in[i]->from);
-		((dir=='f') ? cn->out[i]->to : cn->in[i]->from)->flags |= 2;   // newly added line
-	      }
+	  for ( i=0; i<a.size(); i++ )
+	    {
+	      node *m = (dir=='f') ? a[i]->to : a[i]->from;
+	      if (m->isepiece() && m->scc==-1 && m->span()>cspan && !nsub.testset(m->ID))
+		toBsubdivided.push_back(m);
+	    }
 	  for ( i=0; i<toBsubdivided.size(); i++ )
 	    {
-	      int id = toBsubdivided[i]->ID;
-	      subdivide(id);
-	      n[id]->flags |= 2;
-	      n[n.size()-1]->flags |= 2;
-	      newnodes.push_back(n[id]);
-	      newnodes.push_back(n[n.size()-1]);
+	      subdivide(toBsubdivided[i]->ID);
+	      trv.grow(n.size());
+	      nsub.grow(n.size());
+	      nsub.set(n.size()-1);
+	      newnodes = true;
 	    }
 
-	  for ( i=0; i<((dir=='f') ? cn->out : cn->in).size(); i++ )
-	    if (!(((dir=='f') ? cn->out[i]->to : cn->in[i]->from)->flags&1))
-	      {
-		S.push((dir=='f') ? cn->out[i]->to : cn->in[i]->from);
-		((dir=='f') ? cn->out[i]->to : cn->in[i]->from)->flags |= 1;
-	      }
+	  for ( i=0; i<a.size(); i++ )
+	    {
+	      node *m = (dir=='f') ? a[i]->to : a[i]->from;
+	      if (!trv.testset(m->ID))
+		S.push(m);
+	    }
 	}
 
-      // clear 2 flag
-      for ( i=0; i<newnodes.size(); i++ )
-	newnodes[i]->flags &= ~2;
-
-      if (phase==2 && (!found || !newnodes.size()))
+      if (phase==2 && (!found || !newnodes))
 	break;
 
       if (phase==1) 
 	{
-	  if (!newnodes.size())
+	  if (!newnodes)
 	    if (found)
 	      {
 		phase = 2;
@@ -1181,77 +1988,65 @@ void tgraph::traverse_and_subdivide ( int start, int minlevel, int maxlevel, cha
 	    else
 	      break;
 	}
-	
-      // clear 1 flag
-      for ( i=0; i<traversed.size(); i++ )
-	traversed[i]->flags &= ~1;
     }
 
-  // OK, now merge and protect
+  // OK, now merge and protect; trv still marks the last round's nodes, nsub 
+  // now marks the pieces already processed here. A merge moves the last 
+  // node to the removed one's ID, so its marks are moved along
+  nsub.reset(n.size());
   for ( i=0; i<traversed.size(); i++ )
     {
       node *cn = traversed[i];
       if (cn->scc>=0)
 	continue;
-      cn->flags |= 2;
-      assert(cn->flags&1);
-      int cnid = cn->ID;
-      if (cn->left && (cn->left->flags&2) && !cn->islockedL())
-	{
-	  node *nn = merge(cn->ID,'l');
-	  nn->flags |= (1|2);
-	  cn = nn;
-	}
-      cnid = cn->ID;
-      if (cn->right && (cn->right->flags&2) && !cn->islockedR())
-	{
-	  node *nn = merge(cn->ID,'r');
-	  nn->flags |= (1|2);
-	  cn = nn;
-	}
-      if (cn->right && !(cn->right->flags&1))
+      nsub.set(cn->ID);
+      assert(trv.test(cn->ID));
+      if (cn->left && nsub.test(cn->left->ID) && !cn->islockedL())
+	cn = _mergemarked(cn,'l');
+      if (cn->right && nsub.test(cn->right->ID) && !cn->islockedR())
+	cn = _mergemarked(cn,'r');
+      if (cn->right && !trv.test(cn->right->ID))
 	cn->lockR();
-      if (cn->left && !(cn->left->flags&1))
+      if (cn->left && !trv.test(cn->left->ID))
 	cn->lockL();
     }
+}
 
-  // finally, reset all flags; cannot rely on any of the vectors though
-  {
-    stack<node*> S;
-    S.push(startnode);
-    while (!S.empty())
-      {
-	node *cn = S.top();
-	S.pop();
-	cn->flags &= ~(1|2);
-	for ( i=0; i<((dir=='f') ? cn->out : cn->in).size(); i++ )
-	  if (((dir=='f') ? cn->out[i]->to : cn->in[i]->from)->flags & (1|2))
-	    S.push((dir=='f') ? cn->out[i]->to : cn->in[i]->from);
-      }
-  }
+/* ------------------------------------------------------ */
+
+node *tgraph::_mergemarked ( node *cn, char side )
+{
+  int j = (side=='l') ? cn->left->ID : cn->right->ID;
+  int last = n.size()-1;
+  node *nn = merge(cn->ID,side);
+  if (j!=last)
+    {
+      if (trv.test(last)) trv.set(j); else trv.unset(j);
+      if (nsub.test(last)) nsub.set(j); else nsub.unset(j);
+    }
+  trv.set(nn->ID);
+  nsub.set(nn->ID);
+  return nn;
 }
 
 /* ------------------------------------------------------ */
 
+// saddles are done one at a time, in the order of their first node: each
+// traversal starts from the graph refined, merged and locked by the ones 
+// before it, and their regions overlap (they share the pieces near the 
+// sinks and sources), so concurrent traversals would change the MCG
+
 void tgraph::prepare4MCG ( int minlevel, int maxlevel )
 {
   int i;
-  int count = 0;
-  int all = 0;
 
   bool *done = new bool[SCCs()];
   for ( i=0; i<SCCs(); i++ )
-    {
-      done[i] = false;
-      if (mstp[i].isattracting() || mstp[i].isrepelling())
-	continue;
-      if (mstp[i].istrivial())
-	continue;
-      all++;
-    }
+    done[i] = false;
 
-  cout << "Preparing graph for MCG computation: " << endl;
+  *log << "Preparing graph for MCG computation: " << flush;
 
+  int count = 0;
   for ( i=0; i<n.size(); i++ )
     {
       if (n[i]->scc==-1)
@@ -1263,14 +2058,15 @@ void tgraph::prepare4MCG ( int minlevel, int maxlevel )
       if (mstp[n[i]->scc].istrivial())
 	continue;
       done[n[i]->scc] = true;
-
-      cout << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b" << count++ << " / " << all << flush;
+      count++;
 
       traverse_and_subdivide(i,minlevel,maxlevel,'f');
       traverse_and_subdivide(i,minlevel,maxlevel,'b');
     }
 
   delete[] done;
+
+  *log << count << " saddle Morse sets" << flush;
 }
 
 /* ------------------------------------------------------ */
@@ -1339,57 +2135,179 @@ void tgraph::coarsenMorseSetsP()
 
 tskel *tgraph::MCG (  bool include_trivial )
 {
-  int i,j;
+  int i,j,k;
+  int nn = n.size();
+  int ms = SCCs();
 
-  vector<node*> traversed;
-  tskel * res = new tskel(SCCs(),mstp);
-  bool *done = new bool[SCCs()];
+  if (ms<0)
+    {
+      cout << "MCG: Morse sets have not been computed" << endl;
+      exit(1);
+    }
 
-  for ( i=0; i<SCCs(); i++ )
-    done[i] = false;
+  int words = (ms+63)>>6;   // bitset size
 
-  // construct arcs
+  tskel * res = new tskel(ms,mstp);
 
-  for ( i=0; i<n.size(); i++ )
-    if (n[i] && n[i]->scc>=0 && (!mstp[n[i]->scc].istrivial() || include_trivial) && !done[n[i]->scc])
+  // strongly connected components of the whole graph (iterative Tarjan);
+  // outside of Morse sets, merges done by prepare4MCG may have closed cycles.
+  // Components come out in reverse topological order.
+  int *num = new int[nn];   // DFS number, -1 if not visited
+  int *low = new int[nn];
+  int *comp = new int[nn];  // component; -1 for nodes on the stack
+  int comps = 0;
+  int cnt = 0;
+  vector<int> S;
+  vector<pair<int,int> > cs;  // DFS call stack: node, next out arc
+
+  for ( i=0; i<nn; i++ )
+    num[i] = comp[i] = -1;
+
+  for ( i=0; i<nn; i++ )
+    if (n[i] && num[i]<0)
       {
-	bool *added = new bool[SCCs()];
-	
-	for ( j=0; j<SCCs(); j++ )
-	  added[j] = false;
-
-	// traverse...
-	traversed.clear();
-	stack<node*> S;
-	S.push(n[i]);
-	done[n[i]->scc] = true;
-
-	while(!S.empty())
+	num[i] = low[i] = cnt++;
+	S.push_back(i);
+	cs.push_back(make_pair(i,0));
+	while (!cs.empty())
 	  {
-	    node *cn = S.top();
-	    S.pop();
-	    
-	    cn->flags |= 8;
-	    traversed.push_back(cn);
-
-	    if (cn->scc>=0 && cn->scc!=n[i]->scc && !added[cn->scc] && (include_trivial || !mstp[cn->scc].istrivial()))
+	    int v = cs.back().first;
+	    if (cs.back().second<n[v]->out.size())
+	      {
+		int w = n[v]->out[cs.back().second++]->to->ID;
+		if (num[w]<0)
+		  {
+		    num[w] = low[w] = cnt++;
+		    S.push_back(w);
+		    cs.push_back(make_pair(w,0));
+		  }
+		else
+		  if (comp[w]<0 && num[w]<low[v])
+		    low[v] = num[w];
+	      }
+	    else
 	      {
-		res->add_edge(n[i]->scc,cn->scc);
-		added[cn->scc] = true;
+		cs.pop_back();
+		if (!cs.empty() && low[v]<low[cs.back().first])
+		  low[cs.back().first] = low[v];
+		if (low[v]==num[v])
+		  {
+		    int w;
+		    do
+		      {
+			w = S.back();
+			S.pop_back();
+			comp[w] = comps;
+		      }
+		    while (w!=v);
+		    comps++;
+		  }
 	      }
-	    
-	    for ( j=0; j<cn->out.size(); j++ )
-	      if (!(cn->out[j]->to->flags & 8))
-		S.push(cn->out[j]->to);
 	  }
-	
-	for ( j=0; j<traversed.size(); j++ )
-	  traversed[j]->flags &= ~8;
+      }
 
-	delete[] added;
+  delete[] num;
+  delete[] low;
+
+  // nodes sorted by component; number of arcs entering each component
+  int *first = new int[comps+1];
+  int *order = new int[nn];
+  int *preds = new int[comps];
+  for ( i=0; i<=comps; i++ )
+    first[i] = 0;
+  for ( i=0; i<comps; i++ )
+    preds[i] = 0;
+  for ( i=0; i<nn; i++ )
+    if (n[i])
+      {
+	first[comp[i]+1]++;
+	for ( j=0; j<n[i]->out.size(); j++ )
+	  if (comp[n[i]->out[j]->to->ID]!=comp[i])
+	    preds[comp[n[i]->out[j]->to->ID]]++;
       }
+  for ( i=0; i<comps; i++ )
+    first[i+1] += first[i];
+  for ( i=0; i<nn; i++ )
+    if (n[i])
+      order[first[comp[i]]++] = i;
+  for ( i=comps; i>0; i-- )
+    first[i] = first[i-1];
+  first[0] = 0;
 
-  delete[] done;
+  // Morse sets in the MCG, by component
+  int *msc = new int[SCCs()];  
+  for ( i=0; i<SCCs(); i++ )
+    msc[i] = -1;
+  for ( i=0; i<nn; i++ )
+    if (n[i] && n[i]->scc>=0 && (!mstp[n[i]->scc].istrivial() || include_trivial))
+      msc[n[i]->scc] = comp[i];
+  vector<int> *cms = new vector<int>[comps];
+  for ( i=0; i<SCCs(); i++ )
+    if (msc[i]>=0)
+      cms[msc[i]].push_back(i);
+
+  // sets of Morse sets reachable from each component, successors first;
+  // a set is released once all components with arcs into it are done
+  unsigned long long **R = new unsigned long long*[comps];
+  for ( int c=0; c<comps; c++ )
+    {
+      unsigned long long *r = NULL;
+      for ( k=first[c]; k<first[c+1]; k++ )
+	{
+	  node *cn = n[order[k]];
+	  if (cn->scc>=0 && msc[cn->scc]>=0)
+	    {
+	      if (!r)
+		r = new unsigned long long[words]();
+	      r[cn->scc>>6] |= 1ULL<<(cn->scc&63);
+	    }
+	  for ( j=0; j<cn->out.size(); j++ )
+	    {
+	      int d = comp[cn->out[j]->to->ID];
+	      if (d==c)
+		continue;
+	      if (R[d])
+		{
+		  if (!r)
+		    r = new unsigned long long[words]();
+		  for ( i=0; i<words; i++ )
+		    r[i] |= R[d][i];
+		}
+	      if (!--preds[d] && R[d])
+		{
+		  delete[] R[d];
+		  R[d] = NULL;
+		}
+	    }
+	}
+      R[c] = r;
+
+      if (r)
+	for ( k=0; k<cms[c].size(); k++ )
+	  for ( i=0; i<words; i++ )
+	    for ( unsigned long long w=r[i]; w; w&=w-1 )
+	      {
+		int t = (i<<6)+__builtin_ctzll(w);
+		if (t!=cms[c][k])
+		  res->add_edge(cms[c][k],t);
+	      }
+
+      if (!preds[c] && R[c])
+	{
+	  delete[] R[c];
+	  R[c] = NULL;
+	}
+    }
+
+  for ( i=0; i<comps; i++ )
+    if (R[i]) delete[] R[i];
+  delete[] R;
+  delete[] cms;
+  delete[] msc;
+  delete[] preds;
+  delete[] order;
+  delete[] first;
+  delete[] comp;
 
   res->cleanup();
 
@@ -1398,6 +2316,362 @@ tskel *tgraph::MCG (  bool include_trivial )
 
 /* ------------------------------------------------------ */
 
+// Checkpoint file layout (native byte order, 4 byte fields):
+//  header: see ckpt_header below
+//  node slots: owner (as in _index, -1 for an empty slot), left and right 
+//     neighbor IDs (-1 if none), SCC ID, lock bits, interval endpoints
+//  arcs: source, destination, carrier data; node by node, in out list order
+//  in lists: arc numbers (position in the arc table), node by node
+//  Morse set types: SCCs() raw mstype records, present only if mstsize>0
+//  SCC hierarchy: for each of the levels, the number of SCCs and the parents
+
+#define CKPT_MAGIC "MDPCCKPT"
+#define CKPT_VERSION 3
+
+struct ckpt_header {
+  char magic[8];
+  int version;
+  int vertices, edges, faces;  // used to check that the field matches
+  char options[64];            // as well as the options it was built with
+  int iteration;
+  int pruned;
+  int slots;     // size of n
+  int arcs;
+  int sccs;
+  int mstsize;   // sizeof(mstype), 0 if Morse set types were not computed
+  int levels;    // SCC hierarchy levels
+  int hsize;     // total number of SCC hierarchy entries
+};
+
+struct ckpt_node {
+  int owner, left, right, scc, flags;
+  float s, e;
+};
+
+struct ckpt_arc {
+  int from, to;
+  unsigned int data;
+};
+
+/* ------------------------------------------------------ */
+
+// checks that a checkpoint of sz bytes starting with h has the right size
+// for its header and that every index in it is in range for the field m,
+// so that it can be loaded without further checks: owners are edges or 
+// vertices, neighbors and arc ends are nonempty slots, carriers exist, 
+// SCC IDs are below sccs, each in list holds exactly the arcs ending at its
+// node, and the SCC hierarchy adds up to hsize and links existing SCCs
+
+static bool _validckpt ( const ckpt_header *h, size_t sz, vfield_base *m )
+{
+  int i,k;
+
+  if (h->slots<0 || h->arcs<0 || h->sccs<-1 || h->levels<0 || h->hsize<0 ||
+      (h->mstsize && (h->mstsize!=sizeof(mstype) || h->sccs<0)))
+    return false;
+  if (sz!=sizeof(ckpt_header)+(size_t)h->slots*sizeof(ckpt_node)+
+      (size_t)h->arcs*(sizeof(ckpt_arc)+sizeof(int))+
+      (h->mstsize ? (size_t)h->sccs*sizeof(mstype) : 0)+
+      ((size_t)h->levels+h->hsize)*sizeof(int))
+    return false;
+
+  const ckpt_node *cn = (const ckpt_node*)(h+1);
+  const ckpt_arc *ca = (const ckpt_arc*)(cn+h->slots);
+  const int *ci = (const int*)(ca+h->arcs);
+  const int *ch = (const int*)((const char*)(ci+h->arcs)+(h->mstsize ? (size_t)h->sccs*sizeof(mstype) : 0));
+
+  for ( i=0; i<h->slots; i++ )
+    {
+      const ckpt_node &c = cn[i];
+      if (c.owner==-1)
+	continue;
+      if (c.owner<0 || c.owner>=m->edges()+m->vertices() || 
+	  c.left<-1 || c.left>=h->slots || (c.left>=0 && cn[c.left].owner<0) ||
+	  c.right<-1 || c.right>=h->slots || (c.right>=0 && cn[c.right].owner<0) ||
+	  c.scc<-1 || c.scc>=max(h->sccs,0))
+	return false;
+    }
+
+  vector<int> incnt(h->slots,0);
+  for ( k=0; k<h->arcs; k++ )
+    {
+      const ckpt_arc &a = ca[k];
+      if (a.from<0 || a.from>=h->slots || cn[a.from].owner<0 ||
+	  a.to<0 || a.to>=h->slots || cn[a.to].owner<0)
+	return false;
+      int ix = a.data>>SIXC;
+      switch(a.data & ((1<<SIX0)-1))
+	{
+	case 0: if (ix>=m->vertices()) return false; break;
+	case 1: if (ix>=m->edges()) return false; break;
+	case 2: if (ix>=m->faces()) return false; break;
+	default: return false;
+	}
+      incnt[a.to]++;
+    }
+
+  // in lists, in slot order; every arc has to be listed once, at its end
+  vector<bool> listed(h->arcs,false);
+  for ( i=k=0; i<h->slots; i++ )
+    for ( int j=0; j<incnt[i]; j++, k++ )
+      {
+	if (ci[k]<0 || ci[k]>=h->arcs || listed[ci[k]] || ca[ci[k]].to!=i)
+	  return false;
+	listed[ci[k]] = true;
+      }
+
+  // parents are SCC IDs of the previous level (-1 on level 0)
+  int left = h->hsize;
+  int prev = 0;
+  for ( i=0; i<h->levels; i++ )
+    {
+      if (ch[0]<0 || ch[0]>left)
+	return false;
+      for ( k=1; k<=ch[0]; k++ )
+	if (ch[k]<-1 || ch[k]>=prev)
+	  return false;
+      left -= ch[0];
+      prev = ch[0];
+      ch += ch[0]+1;
+    }
+  return left==0;
+}
+
+/* ------------------------------------------------------ */
+
+bool tgraph::save ( const char *name, int iteration, const char *options )
+{
+  int i,j,k;
+  ofstream ofs(name,ios::binary);
+
+  if (!ofs)
+    {
+      cout << "Can't open file " << name << " for writing the checkpoint..." << endl;
+      return false;
+    }
+
+  ckpt_header h;
+  memcpy(h.magic,CKPT_MAGIC,8);
+  h.version = CKPT_VERSION;
+  h.vertices = msh->vertices();
+  h.edges = msh->edges();
+  h.faces = msh->faces();
+  memset(h.options,0,sizeof(h.options));
+  strncpy(h.options,options,sizeof(h.options)-1);
+  h.iteration = iteration;
+  h.pruned = pruned;
+  h.slots = n.size();
+  h.sccs = sccs;
+  h.mstsize = mstp ? sizeof(mstype) : 0;
+  h.levels = hier.size();
+  h.hsize = 0;
+  for ( i=0; i<hier.size(); i++ )
+    h.hsize += hier[i].size();
+
+  // arc numbers: arcs are numbered in out list order, so the number of
+  // an arc is base[source]+(position in the out list of the source)
+  int *base = new int[n.size()];
+  h.arcs = 0;
+  for ( i=0; i<n.size(); i++ )
+    {
+      base[i] = h.arcs;
+      if (n[i])
+	h.arcs += n[i]->out.size();
+    }
+
+  ofs.write((char*)&h,sizeof(h));
+
+  ckpt_node *cn = new ckpt_node[n.size()];
+  for ( i=0; i<n.size(); i++ )
+    {
+      ckpt_node &c = cn[i];
+      if (!n[i])
+	{
+	  c.owner = c.left = c.right = c.scc = -1;
+	  c.flags = 0;
+	  c.s = c.e = 0;
+	  continue;
+	}
+      c.owner = _index(n[i]->owner);
+      c.left = n[i]->left ? n[i]->left->ID : -1;
+      c.right = n[i]->right ? n[i]->right->ID : -1;
+      c.scc = n[i]->scc;
+      c.flags = n[i]->flags & (16|32);
+      c.s = n[i]->s;
+      c.e = n[i]->e;
+    }
+  ofs.write((char*)cn,n.size()*sizeof(ckpt_node));
+  delete[] cn;
+
+  ckpt_arc *ca = new ckpt_arc[h.arcs];
+  int *ci = new int[h.arcs];
+  for ( i=k=0; i<n.size(); i++ )
+    if (n[i])
+      for ( j=0; j<n[i]->out.size(); j++, k++ )
+	{
+	  ca[k].from = i;
+	  ca[k].to = n[i]->out[j]->to->ID;
+	  ca[k].data = n[i]->out[j]->data;
+	}
+  for ( i=k=0; i<n.size(); i++ )
+    if (n[i])
+      for ( j=0; j<n[i]->in.size(); j++, k++ )
+	{
+	  arc *a = n[i]->in[j];
+	  int l;
+	  for ( l=0; a->from->out[l]!=a; l++ )
+	    ;
+	  ci[k] = base[a->from->ID]+l;
+	}
+  ofs.write((char*)ca,h.arcs*sizeof(ckpt_arc));
+  ofs.write((char*)ci,h.arcs*sizeof(int));
+  delete[] ca;
+  delete[] ci;
+  delete[] base;
+
+  if (mstp)
+    ofs.write((char*)mstp,sccs*sizeof(mstype));
+
+  for ( i=0; i<hier.size(); i++ )
+    {
+      int l = hier[i].size();
+      ofs.write((char*)&l,sizeof(int));
+      if (l)
+	ofs.write((char*)&hier[i][0],l*sizeof(int));
+    }
+
+  if (!ofs)
+    {
+      cout << "Error writing checkpoint " << name << endl;
+      return false;
+    }
+  return true;
+}
+
+/* ------------------------------------------------------ */
+
+tgraph::tgraph ( vfield_base *m, const char *checkpoint, int *iteration, const char *options ) :
+  msh(m), mstp(NULL), sccs(-1), n(), pruned(false), rtop(0), log(&cout), sdv(&tgraph::_subdivide<vfield_base>)
+{
+  int i,j,k;
+  struct stat st;
+
+  int fd = open(checkpoint,O_RDONLY);
+  if (fd<0 || fstat(fd,&st))
+    {
+      cout << "Can't open checkpoint " << checkpoint << endl;
+      exit(1);
+    }
+
+  size_t sz = st.st_size;
+  char *buf = NULL;
+  if (sz>=sizeof(ckpt_header))
+    buf = (char*)mmap(NULL,sz,PROT_READ,MAP_PRIVATE,fd,0);
+  if (!buf || buf==MAP_FAILED)
+    {
+      cout << "Can't read checkpoint " << checkpoint << endl;
+      exit(1);
+    }
+
+  ckpt_header *h = (ckpt_header*)buf;
+  if (memcmp(h->magic,CKPT_MAGIC,8) || h->version!=CKPT_VERSION)
+    {
+      cout << checkpoint << " is not a checkpoint file or has a wrong version" << endl;
+      exit(1);
+    }
+  if (h->vertices!=msh->vertices() || h->edges!=msh->edges() || h->faces!=msh->faces())
+    {
+      cout << "Checkpoint " << checkpoint << " was computed for a different input" << endl;
+      exit(1);
+    }
+  if (strncmp(h->options,options,sizeof(h->options)-1))
+    {
+      cout << "Checkpoint " << checkpoint << " was computed with options \"" 
+	   << string(h->options,strnlen(h->options,sizeof(h->options))) 
+	   << "\", not \"" << options << "\"" << endl;
+      exit(1);
+    }
+  if (!_validckpt(h,sz,msh))
+    {
+      cout << "Checkpoint " << checkpoint << " is corrupt" << endl;
+      exit(1);
+    }
+
+  ckpt_node *cn = (ckpt_node*)(buf+sizeof(ckpt_header));
+  ckpt_arc *ca = (ckpt_arc*)(cn+h->slots);
+  int *ci = (int*)(ca+h->arcs);
+  char *cm = (char*)(ci+h->arcs);
+
+  // nodes first; neighbors once all nodes exist
+  n.resize(h->slots,NULL);
+  for ( i=0; i<h->slots; i++ )
+    {
+      if (cn[i].owner<0)
+	continue;
+      mesh_element *o = msh->get(msh->faces()+cn[i].owner);
+      if (o->dimension==1)
+	n[i] = new node(i,o,NULL,NULL,cn[i].s,cn[i].e);
+      else
+	n[i] = new node(i,o);
+      n[i]->scc = cn[i].scc;
+      n[i]->flags = cn[i].flags;
+    }
+  for ( i=0; i<h->slots; i++ )
+    if (n[i])
+      {
+	n[i]->left = cn[i].left>=0 ? n[cn[i].left] : NULL;
+	n[i]->right = cn[i].right>=0 ? n[cn[i].right] : NULL;
+      }
+
+  // arcs are stored in out list order, so out lists come out right;
+  // in lists are put back in the saved order afterwards
+  arc **al = new arc*[h->arcs];
+  for ( k=0; k<h->arcs; k++ )
+    al[k] = new arc(n[ca[k].from],n[ca[k].to],ca[k].data);
+  for ( i=k=0; i<h->slots; i++ )
+    if (n[i])
+      for ( j=0; j<n[i]->in.size(); j++ )
+	n[i]->in[j] = al[ci[k++]];
+  delete[] al;
+
+  sccs = h->sccs;
+  pruned = h->pruned;
+  if (h->mstsize && sccs>0)
+    {
+      mstp = new mstype[sccs];
+      memcpy(mstp,cm,sccs*sizeof(mstype));
+      cm += sccs*sizeof(mstype);
+    }
+
+  int *ch = (int*)cm;
+  for ( i=0; i<h->levels; i++ )
+    {
+      hier.push_back(vector<int>(ch+1,ch+1+ch[0]));
+      ch += ch[0]+1;
+    }
+  if (iteration)
+    *iteration = h->iteration;
+
+  munmap(buf,sz);
+  close(fd);
+}
+
+/* ------------------------------------------------------ */
+
+bool tgraph::ispruned()
+{
+  return pruned;
+}
+
+/* ------------------------------------------------------ */
+
+void tgraph::set_log ( ostream &o )
+{
+  log = &o;
+}
+
+/* ------------------------------------------------------ */
+
 void node::print_out (  )
 {
   int i;
@@ -1448,14 +2722,28 @@ double tgraph::usedspace()
 
 /* ------------------------------------------------------ */
 
+double tgraph::memory()
+{
+  double res = n.capacity()*sizeof(node*);
+
+  for ( int i=0; i<n.size(); i++ )
+    if (n[i])
+      res += sizeof(node)+n[i]->out.size()*sizeof(arc)+
+	(n[i]->in.capacity()+n[i]->out.capacity())*sizeof(arc*);
+
+  return res;
+}
+
+/* ------------------------------------------------------ */
+
 tgraph::~tgraph()
 {
-  /*
-  while(nodes())
-    {
-      remove_node(0);
-    }
-  */
+  // nodes delete their arcs; with several graphs in one run (mdpc with a 
+  // list of values) they can't be left to process exit
+  for ( int i=0; i<n.size(); i++ )
+    if (n[i])
+      delete n[i];
+  n.clear();
 
   delete msh;
   msh = NULL;
@@ -37,6 +37,7 @@
 class arc;
 class node;
 class tgraph;
+class nodemark;
 
 /* ------------------------------------------------------ */
 /* ------------------------------------------------------ */
@@ -57,16 +58,13 @@ class node {
   float s,e;        // start and end parameter
   int scc;           // strongly connected component ID
 
-  // bits 0, 1, 2 and 3 used for MCG computation, bits 6 and 7: when merging nodes
-  // bits 4 and 5 used to protect from mergers
+  // bits 4 and 5 used to protect from mergers (traversals use nodemark)
   unsigned char flags;
 
   int ID;
 
  public:
 
-  static int nodes;
-
   node ( int id, mesh_element *o );  // use this only for vertex nodes
   node ( int id, mesh_element *o, node *l, node *r, double ss, double ee ); // only for edge pieces  
   ~node();
@@ -75,11 +73,6 @@ class node {
 
   void print_out ( );
 
-  // related to MCG computation
-  // in both cases, return nodes not in scc but in (un)stable set
-  void markf ( unsigned char msk, std::vector<node*> *lst = NULL );  // forward DFS
-  void markb ( unsigned char msk, std::vector<node*> *lst = NULL );  // backward DFS
-
   double span();
 
   // protect endpoints
@@ -102,11 +95,10 @@ class arc {
 
  public:
 
-  static int arcs;
-
   arc ( node *f, node *t, mesh_element *carrier, int ix_orig, int ix_dest );  // 2D carrier only
   arc ( node *f, node *t, mesh_element *carrier );
   arc ( node *f, node *t, arc *a );   // copies data to the new arc
+  arc ( node *f, node *t, unsigned int d );  // raw carrier data (checkpoint reload)
   ~arc();
 
   // extract carrier data from data field
@@ -118,6 +110,43 @@ class arc {
 
 /* ------------------------------------------------------ */
 
+// visited marks for one traversal, indexed by node ID; a node is marked if 
+// its stamp equals the current epoch, so reset() doesn't need a clearing pass.
+// Concurrent traversals need separate nodemarks.
+
+class nodemark {
+
+  std::vector<unsigned int> stamp;
+  unsigned int epoch;
+
+ public:
+
+  nodemark();
+
+  void reset ( int size );  // unmark all; IDs up to size-1 can be used
+  void grow ( int size );   // IDs up to size-1 can be used, marks are kept
+  bool test ( int id );
+  void set ( int id );
+  bool testset ( int id );  // marks id; returns true if it was marked already
+  void unset ( int id );
+};
+
+/* ------------------------------------------------------ */
+
+// coarse face arcs of a field, kept from one frame of a time series to the
+// next: the pairs of boundary elements of face i connected by flow across 
+// it are pr[off[i]..off[i+1]-1], the first element in the low byte
+
+class farcs {
+
+ public:
+
+  std::vector<int> off;
+  std::vector<unsigned short> pr;
+};
+
+/* ------------------------------------------------------ */
+
 class tgraph {
 
   std::vector<node*> n;   // all graph nodes
@@ -130,26 +159,66 @@ class tgraph {
   int sccs;
   mstype *mstp;
 
+  // SCC hierarchy: one entry per computeSCCs() call, mapping each SCC
+  // to the SCC of the previous call that contains it (-1 if none)
+  std::vector<std::vector<int> > hier;
+
+  // radius hierarchy, same layout as hier (see computeRadiusTree); its level 0
+  // refers to the SCC labeling of hier level rtop-1
+  std::vector<std::vector<int> > rhier;
+  int rtop;
+  bool _infield ( arc *a, vfield_base *f );  // a (not a face arc) is in the graph of f
+  // adds to ps and pd the pairs of pieces from a[0..na-1] (boundary element 
+  // ea of face fce) and b[0..nb-1] (element eb), both sorted, that f connects
+  static void _connected ( vfield_base *f, int fce, int ea, node **a, int na, int eb, node **b, int nb,
+			   std::vector<int> &ps, std::vector<int> &pd );
+
+  bool pruned;  // true once remove_all_nonSCC was called
+
+  std::ostream *log;  // progress messages; cout unless set_log() was called
+
   // index in the coarse graph ONLY
   int _index ( mesh_element *e ); 
   node *_getnode ( mesh_element *e );
   node *_getvertexnode ( int i );
   node *_getedgenode ( int i );
 
-  void clear_flags();
+  // appends to cq the pairs of boundary elements of face i that may be 
+  // connected by flow across it; D>0 is the number of edges of every face,
+  // known at compile time for triangle and quad meshes; D=0 handles any polygons
+  template<int D> void _facequeries ( int i );
+
+  // builds the coarse graph; see the constructors
+  void _build ( farcs *fa, const bool *changed );
+
+  // connects_batch queries and results, reused by the constructor and subdivide
+  std::vector<cquery> cq;
+  std::vector<unsigned char> cr;
 
   // MCG related calls
+  nodemark fwd,bwd;  // set by mark()
+  std::vector<node*> frontier;  // _sweep scratch, kept to reuse its storage
+  nodemark mrgo,mrgi;  // used by merge
   void mark();   // mark nodes on generalized separatrices; assumes complete Morse set data
+  void _sweep ( std::vector<node*> &seeds, char dir, nodemark &m );  // mark nodes reachable from (dir=='f') or reaching seeds
+  bool _inregion ( int i, bool both );  // node i marked by fwd and (both) / or bwd
+  void _saveregion ( const char *name, bool both );  // arcs and pieces in region
+  nodemark trv,nsub;  // traversed and newly subdivided nodes, for traverse_and_subdivide
   void traverse_and_subdivide ( int start, int minlevel, int maxlevel, char dir );
+  node *_mergemarked ( node *cn, char side );  // merge that keeps trv and nsub valid
 
   // node removal
   void remove_node ( int i );
 
   // refinement related calls
   void subdivide ( int i, double spt = 0.5 );
+  // subdivide with the calls to the field bound statically to VF's 
+  // implementation; VF=vfield_base makes plain virtual calls
+  template<class VF> void _subdivide ( int i, double spt );
+  void (tgraph::*sdv) ( int i, double spt );  // the one used by subdivide()
 
   // side can be 'l', 'r', 'L' or 'R' (to merge with left or right neighbor)
-  // merge just copies the attrtibutes (scc, flags) from node i to the new node
+  // merge just copies the attrtibutes (scc) from node i to the new node
   node* merge ( int i, char side, bool move = true );
 
 
@@ -159,13 +228,42 @@ class tgraph {
  public:
 
   tgraph ( vfield_base *m );   // build a coarse graph
+  // same, for the next frame of a time series: the face arcs of faces not 
+  // marked in changed (one flag per face; see vfield_base::spread_changes) 
+  // are taken from fa, which has to hold those of the previous frame's 
+  // graph, and fa gets the ones of this graph; changed==NULL computes all 
+  // of them (first frame)
+  tgraph ( vfield_base *m, farcs *fa, const bool *changed );
+  // reload a graph from a checkpoint written by save(); m has to be built 
+  // from the same input; iteration (if not NULL) receives the saved iteration number.
+  // Exits if the checkpoint was saved with different options (see save())
+  tgraph ( vfield_base *m, const char *checkpoint, int *iteration = NULL, const char *options = "" );
   ~tgraph();
 
+  // bind the refinement kernels to the field class VF (pcvf, pcstable, 
+  // pchull or pcenv), which has to be the class of the field the graph 
+  // was built for; without it, the kernels make virtual calls
+  template<class VF> void specialize();
+
+  // write nodes, intervals, lock bits, arcs, SCC ids and Morse set types
+  // to a binary checkpoint; returns false if the file can't be written.
+  // options (at most 63 chars) describes how the field was built
+  bool save ( const char *name, int iteration = 0, const char *options = "" );
+  bool ispruned();  // non-SCC nodes were removed (checkpoint unusable for MCG)
+
+  void set_log ( std::ostream &o );  // where the progress messages go
+
   void print_out();
   double usedspace();  // size-to-capacity ratio for edge lists (just a statistics)
+  double memory();     // bytes used by nodes, arcs and their edge lists
 
   void subdivide_all();
   void subdivide_scc_nodes();
+  // subdivide_scc_nodes that keeps memory() (estimated) under budget bytes; if 
+  // refining all SCCs doesn't fit, refines the highest priority SCCs that do
+  // (ambiguous Morse set types first, then largest total span);
+  // returns the number of SCCs refined
+  int subdivide_scc_nodes ( double budget );
 
   // merge edge pieces in the same Morse set
   void coarsenMorseSets();  
@@ -175,18 +273,44 @@ class tgraph {
   void computeSCCs();
   void computeMSTypes();
   int SCCs();     // returns number of SCCs
+
+  // SCC hierarchy across refinement iterations; level 0 is the first
+  // computeSCCs() call, levels()-1 the current labeling
+  int levels();
+  int SCCs ( int level );                // number of SCCs at a level
+  int SCCparent ( int level, int i );    // SCC at level-1 containing SCC i of level
+  int SCCancestor ( int i, int level );  // SCC at level containing current SCC i
+  void saveSCCtree ( const char *name ); // text file: levels, then count and parents per level
+
+  // nested Morse sets for the fields f, pcstable fields derived from the 
+  // same pcvf as msh with decreasing radii, all smaller than msh's: level 0 
+  // are the current SCCs, level l>0 the Morse sets of the graph f[l-1] gives 
+  // on the current nodes, each inside one of level l-1; assumes up to date 
+  // SCCs, and that connects() is true for intervals if it is for a part of them
+  void computeRadiusTree ( const std::vector<vfield_base*> &f );
+  int radiusLevels();
+  int radiusSCCs ( int level );
+  void saveRadiusTree ( const char *name ); // same format as saveSCCtree
   mstype MStype ( int i );
   void saveMorseSets ( const char *name ); // assumes up to date SCC and MS type info
 
   // MCG computation; assumes Morse sets and their types are up to date
-  void prepare4MCG ( int minlevel, int maxlevel );  // uses bits 0 and 1 of flags
+  void prepare4MCG ( int minlevel, int maxlevel );
   void saveSeparatrices ( const char *name );
   tskel *MCG ( bool include_trivial = false );
 
+  // connection from Morse set a to Morse set b: refines the edge pieces outside
+  // Morse sets in the forward region of a intersected with the backward region
+  // of b, down to span 2^-level, and returns false if the (refined) region is
+  // empty, i.e. b certainly can't be reached from a; assumes up to date SCCs
+  // and a!=b
+  bool connection ( int a, int b, int level );
+  void saveConnection ( const char *name );  // region of the last connection() call
+
   // remove all nodes except adjacent to an scc
   void remove_all_nonSCC();
 
-  int nodes();
+  int nodes();   // of this graph
   int arcs();
   int arcs2();
 };
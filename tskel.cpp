@@ -27,6 +27,8 @@
 #include <tskel.h>
 #include <fstream>
 #include <cassert>
+#include <algorithm>
+#include <functional>
 
 using namespace std;
 
@@ -107,7 +109,7 @@ tskel::tskel ( int nn, mstype *B ) : ns(nn)
 
 void tskel::add_edge ( int i, int j )
 {
-  if (hasedge(i,j) || i==j) return;
+  if (i==j || !E.insert((unsigned long long)i*ns+j).second) return;
   n[i].out.push_back(j);
   n[j].in.push_back(i);
 }
@@ -116,6 +118,7 @@ void tskel::add_edge ( int i, int j )
 
 void tskel::remove_edge ( int i, int j )
 {
+  E.erase((unsigned long long)i*ns+j);
   n[i].removeout(j);
   n[j].removein(i);
 }
@@ -157,14 +160,19 @@ void tskel::save ( const char *name )
 
       ofs << " ]" << endl;
     }
+  // edges by source, then by target, whatever order they were added in
   for ( i=0; i<ns; i++ )
-    for ( j=0; j<n[i].out.size(); j++ )
-      {
-	ofs << i << "->" << n[i].out[j];
-	if (!iscertain(i,n[i].out[j]))
-	  ofs << " [style=dotted]";
-	ofs << endl;
-      }
+    {
+      vector<int> out = n[i].out;
+      sort(out.begin(),out.end());
+      for ( j=0; j<out.size(); j++ )
+	{
+	  ofs << i << "->" << out[j];
+	  if (!iscertain(i,out[j]))
+	    ofs << " [style=dotted]";
+	  ofs << endl;
+	}
+    }
   ofs << "}" << endl;
 }
 
@@ -172,26 +180,165 @@ void tskel::save ( const char *name )
 
 void tskel::cleanup()
 {
-  vector<int> a,b;
+  int i,j,c;
+
+  // strongly connected components (iterative Tarjan); they come out in 
+  // reverse topological order, i.e. edges between components go from a 
+  // higher to a lower component number
+  int *num = new int[ns];   // DFS number, -1 if not visited
+  int *low = new int[ns];
+  int *comp = new int[ns];  // component; -1 for nodes on the stack
+  int comps = 0;
+  int cnt = 0;
+  vector<int> S;
+  vector<pair<int,int> > cs;  // DFS call stack: node, next out edge
 
-  for ( int i=0; i<ns; i++ )
-    for ( int j=0; j<n[i].out.size(); j++ )
-      for ( int k=0; k<n[n[i].out[j]].out.size(); k++ )
+  for ( i=0; i<ns; i++ )
+    num[i] = comp[i] = -1;
+
+  for ( i=0; i<ns; i++ )
+    if (num[i]<0)
+      {
+	num[i] = low[i] = cnt++;
+	S.push_back(i);
+	cs.push_back(make_pair(i,0));
+	while (!cs.empty())
+	  {
+	    int v = cs.back().first;
+	    if (cs.back().second<n[v].out.size())
+	      {
+		int w = n[v].out[cs.back().second++];
+		if (num[w]<0)
+		  {
+		    num[w] = low[w] = cnt++;
+		    S.push_back(w);
+		    cs.push_back(make_pair(w,0));
+		  }
+		else
+		  if (comp[w]<0 && num[w]<low[v])
+		    low[v] = num[w];
+	      }
+	    else
+	      {
+		cs.pop_back();
+		if (!cs.empty() && low[v]<low[cs.back().first])
+		  low[cs.back().first] = low[v];
+		if (low[v]==num[v])
+		  {
+		    int w;
+		    do
+		      {
+			w = S.back();
+			S.pop_back();
+			comp[w] = comps;
+		      }
+		    while (w!=v);
+		    comps++;
+		  }
+	      }
+	  }
+      }
+
+  delete[] num;
+  delete[] low;
+
+  // condensation: successor components of each component, closest first
+  vector<vector<int> > succ(comps);
+  for ( i=0; i<ns; i++ )
+    for ( j=0; j<n[i].out.size(); j++ )
+      if (comp[i]!=comp[n[i].out[j]])
+	succ[comp[i]].push_back(comp[n[i].out[j]]);
+
+  int *preds = new int[comps];
+  for ( c=0; c<comps; c++ )
+    preds[c] = 0;
+  for ( c=0; c<comps; c++ )
+    {
+      sort(succ[c].begin(),succ[c].end(),greater<int>());
+      succ[c].erase(unique(succ[c].begin(),succ[c].end()),succ[c].end());
+      for ( j=0; j<succ[c].size(); j++ )
+	preds[succ[c][j]]++;
+    }
+
+  // components reachable from each component (bitsets, NULL if none); 
+  // sinks first, so those of the successors are ready. A successor already 
+  // reachable through a closer one is redundant. A bitset is freed once 
+  // all predecessors have used it.
+  int words = (comps+63)>>6;
+  unsigned long long **reach = new unsigned long long*[comps];
+  unordered_set<unsigned long long> redundant;  // c*comps+d
+
+  for ( c=0; c<comps; c++ )
+    {
+      reach[c] = NULL;
+      if (succ[c].size())
+	{
+	  reach[c] = new unsigned long long[words];
+	  for ( j=0; j<words; j++ )
+	    reach[c][j] = 0;
+	}
+
+      for ( j=0; j<succ[c].size(); j++ )
+	{
+	  int d = succ[c][j];
+	  if ((reach[c][d>>6]>>(d&63))&1)
+	    redundant.insert((unsigned long long)c*comps+d);
+	  else
+	    {
+	      reach[c][d>>6] |= 1ULL<<(d&63);
+	      if (reach[d])
+		for ( int k=0; k<words; k++ )
+		  reach[c][k] |= reach[d][k];
+	    }
+	  if (!--preds[d] && reach[d])
+	    {
+	      delete[] reach[d];
+	      reach[d] = NULL;
+	    }
+	}
+
+      if (!preds[c] && reach[c])
+	{
+	  delete[] reach[c];
+	  reach[c] = NULL;
+	}
+    }
+
+  delete[] reach;
+  delete[] preds;
+
+  // drop edges realizing redundant condensation edges; in lists are rebuilt
+  // rather than searched for every removed edge
+  if (redundant.size())
+    {
+      for ( i=0; i<ns; i++ )
 	{
-	  a.push_back(i);
-	  b.push_back(n[n[i].out[j]].out[k]);
+	  int m = 0;
+	  for ( j=0; j<n[i].out.size(); j++ )
+	    {
+	      int k = n[i].out[j];
+	      if (comp[i]!=comp[k] && 
+		  redundant.count((unsigned long long)comp[i]*comps+comp[k]))
+		E.erase((unsigned long long)i*ns+k);
+	      else
+		n[i].out[m++] = k;
+	    }
+	  n[i].out.resize(m);
+	  n[i].in.clear();
 	}
+      for ( i=0; i<ns; i++ )
+	for ( j=0; j<n[i].out.size(); j++ )
+	  n[n[i].out[j]].in.push_back(i);
+    }
 
-  for ( int l=0; l<a.size(); l++ )
-    remove_edge(a[l],b[l]);
+  delete[] comp;
 }
 
 /* ------------------------------------------------------------------ */
 
 bool tskel::hasedge ( int i, int j )
 {
-  assert(n[i].hasedgeto(j)==n[j].hasedgefrom(i));
-  return n[i].hasedgeto(j);
+  return E.count((unsigned long long)i*ns+j)>0;
 }
 
 /* ------------------------------------------------------------------ */
@@ -29,6 +29,7 @@
 
 #include <global.h>
 #include <vector>
+#include <unordered_set>
 #include <mstype.h>
 
 /* ------------------------------------------------------------------ */
@@ -59,14 +60,15 @@ class tskel {
  public:
   int ns;
   tsknode *n;
+  std::unordered_set<unsigned long long> E;  // i*ns+j for each edge i->j
 
   tskel ( int nn, mstype *t );
   ~tskel();
 
   void add_edge ( int i, int j );
   void remove_edge ( int i, int j );
-  void save ( const char *name );
-  void cleanup();
+  void save ( const char *name );  // dot file; edges sorted by source, then target
+  void cleanup();  // transitive reduction (edges within cycles are kept)
   bool hasedge ( int i, int j );
   bool iscertain ( int i, int j );
 };
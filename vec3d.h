@@ -31,12 +31,31 @@
 #include <cmath>
 #include <cstdlib>
 #include <assert.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 /* ---------------------------------------------------------------------------- */
 
+// storage of vec3d<T>: doubles are padded to four lanes (the fourth kept 
+// at 0) and aligned so that they load into one 256-bit register
 template<class T>
-class vec3d {
-  T x[3];
+class vec3d_lanes {
+ public:
+  enum { n = 3, align = alignof(T) };
+};
+
+template<>
+class vec3d_lanes<double> {
+ public:
+  enum { n = 4, align = 32 };
+};
+
+/* ---------------------------------------------------------------------------- */
+
+template<class T>
+class alignas(vec3d_lanes<T>::align) vec3d {
+  T x[vec3d_lanes<T>::n];
 
  public:
   
@@ -44,33 +63,34 @@ class vec3d {
   vec3d ( T a );   // diagonal vector [a a a]
   vec3d();
   vec3d ( const vec3d<T> &v );
-  vec3d & operator= ( vec3d<T> v );
+  vec3d & operator= ( const vec3d<T> &v );
   ~vec3d();
   
   template<class U>
-    vec3d ( vec3d<U> w )
+    vec3d ( const vec3d<U> &w ) : x()
     {
       x[0] = w[0];
       x[1] = w[1];
       x[2] = w[2];
     }
 
-  vec3d & operator+= ( vec3d<T> v );
-  vec3d & operator-= ( vec3d<T> v );
-  vec3d & operator^= ( vec3d<T> v );   // cross-prouct
+  vec3d & operator+= ( const vec3d<T> &v );
+  vec3d & operator-= ( const vec3d<T> &v );
+  vec3d & operator^= ( const vec3d<T> &v );   // cross-prouct
   vec3d & operator*= ( T s );          // multiply by scalar
-  vec3d & operator|= ( vec3d<T> v );
-  vec3d & operator&= ( vec3d<T> v );
+  vec3d & operator|= ( const vec3d<T> &v );
+  vec3d & operator&= ( const vec3d<T> &v );
 
-  T norm();
-  T norm2();
-  T min();
-  T max();
+  T norm() const;
+  T norm2() const;
+  T min() const;
+  T max() const;
 
   void normalize();
   void writeto ( std::ostream &o );
 
   T& operator[] ( int i );
+  const T& operator[] ( int i ) const;
 
   T* pointer();
 };
@@ -82,58 +102,69 @@ typedef vec3d<double> vec3dd;
 typedef vec3d<int> vec3di;
 typedef vec3d<unsigned short int> vec3dus;
 
+// storage of geometry and vector data: float if MDPC_FLOAT is defined
+// (see global.h), double otherwise. Arrays of vec3dg are allocated with
+// unsigned counts: GCC can't tell that the int counts are nonnegative and
+// warns (-Walloc-size-larger-than) in the float build otherwise
+#ifdef MDPC_FLOAT
+typedef float greal;
+#else
+typedef double greal;
+#endif
+typedef vec3d<greal> vec3dg;
+
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-extern vec3d<T> operator+ ( vec3d<T> p, vec3d<T> q );
+vec3d<T> operator+ ( const vec3d<T> &p, const vec3d<T> &q );
 
 template<class T>
-extern vec3d<T> operator- ( vec3d<T> p, vec3d<T> q );
+vec3d<T> operator- ( const vec3d<T> &p, const vec3d<T> &q );
 
 template<class T>
-extern vec3d<T> operator| ( vec3d<T> p, vec3d<T> q );
+vec3d<T> operator| ( const vec3d<T> &p, const vec3d<T> &q );
 
 template<class T>
-extern vec3d<T> operator& ( vec3d<T> p, vec3d<T> q );
+vec3d<T> operator& ( const vec3d<T> &p, const vec3d<T> &q );
 
 template<class T>
-extern vec3d<T> operator- ( vec3d<T> p );
+vec3d<T> operator- ( const vec3d<T> &p );
 
 template<class T>
-extern vec3d<T> operator^ ( vec3d<T> p, vec3d<T> q );
+vec3d<T> operator^ ( const vec3d<T> &p, const vec3d<T> &q );
 
 template<class T>
-extern vec3d<T> operator* ( T p, vec3d<T> q );
+vec3d<T> operator* ( T p, const vec3d<T> &q );
 
 template<class T>
-extern T operator* ( vec3d<T> p, vec3d<T> q );
+T operator* ( const vec3d<T> &p, const vec3d<T> &q );
 
 template<class T>
-std::ostream & operator<< ( std::ostream &o, vec3d<T> v );
+std::ostream & operator<< ( std::ostream &o, const vec3d<T> &v );
 
 template<class T>
 vec3d<T> randomv();
 
 template<class T>
-extern bool operator== ( vec3d<T> p, vec3d<T> q );
+bool operator== ( const vec3d<T> &p, const vec3d<T> &q );
 
 template<class T>
-extern bool operator!= ( vec3d<T> p, vec3d<T> q );
+bool operator!= ( const vec3d<T> &p, const vec3d<T> &q );
 
 template<class T>
-extern bool operator< (  vec3d<T> p, vec3d<T> q );
+bool operator< (  const vec3d<T> &p, const vec3d<T> &q );
 
 template<class T>
-extern bool operator> (  vec3d<T> p, vec3d<T> q );
+bool operator> (  const vec3d<T> &p, const vec3d<T> &q );
 
 template<class T>
-extern bool operator<= (  vec3d<T> p, vec3d<T> q );
+bool operator<= (  const vec3d<T> &p, const vec3d<T> &q );
 
 template<class T>
-extern bool operator>= (  vec3d<T> p, vec3d<T> q );
+bool operator>= (  const vec3d<T> &p, const vec3d<T> &q );
 
 template<class T>
-extern vec3d<T> average ( vec3d<T> u, vec3d<T> w );
+vec3d<T> average ( const vec3d<T> &u, const vec3d<T> &w );
 
 /* ---------------------------------------------------------------------------- */
 /* ------------------- IMPLEMENTATION ----------------------------------------- */
@@ -148,7 +179,7 @@ T* vec3d<T>::pointer()
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-T vec3d<T>::min()
+T vec3d<T>::min() const
 {
   if (x[0]>x[1])
     return x[1]<x[2] ? x[1] : x[2];
@@ -160,7 +191,7 @@ T vec3d<T>::min()
 
 
 template<class T>
-T vec3d<T>::max()
+T vec3d<T>::max() const
 {
   if (x[0]<x[1])
     return x[1]>x[2] ? x[1] : x[2];
@@ -179,7 +210,7 @@ vec3d<T>::~vec3d()
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T>::vec3d ( T a, T b, T c )
+vec3d<T>::vec3d ( T a, T b, T c ) : x()
 {
   x[0] = a;
   x[1] = b;
@@ -189,7 +220,7 @@ vec3d<T>::vec3d ( T a, T b, T c )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T>::vec3d ( T a )
+vec3d<T>::vec3d ( T a ) : x()
 {
   x[0] = a;
   x[1] = a;
@@ -199,7 +230,7 @@ vec3d<T>::vec3d ( T a )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T>::vec3d ( )
+vec3d<T>::vec3d ( ) : x()
 {
   x[0] = 0;
   x[1] = 0;
@@ -211,26 +242,24 @@ vec3d<T>::vec3d ( )
 template<class T>
 vec3d<T>::vec3d ( const vec3d<T> &v )
 {
-  x[0] = v.x[0];
-  x[1] = v.x[1];
-  x[2] = v.x[2];
+  for ( int i=0; i<vec3d_lanes<T>::n; i++ )
+    x[i] = v.x[i];
 }
 
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> & vec3d<T>::operator= ( vec3d<T> v )
+vec3d<T> & vec3d<T>::operator= ( const vec3d<T> &v )
 {
-  x[0] = v.x[0];
-  x[1] = v.x[1];
-  x[2] = v.x[2];
+  for ( int i=0; i<vec3d_lanes<T>::n; i++ )
+    x[i] = v.x[i];
   return *this;
 }
 
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> & vec3d<T>::operator+= ( vec3d<T> v )
+vec3d<T> & vec3d<T>::operator+= ( const vec3d<T> &v )
 {
   x[0] += v.x[0];
   x[1] += v.x[1];
@@ -241,7 +270,7 @@ vec3d<T> & vec3d<T>::operator+= ( vec3d<T> v )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> & vec3d<T>::operator-= ( vec3d<T> v )
+vec3d<T> & vec3d<T>::operator-= ( const vec3d<T> &v )
 {
   x[0] -= v.x[0];
   x[1] -= v.x[1];
@@ -252,7 +281,7 @@ vec3d<T> & vec3d<T>::operator-= ( vec3d<T> v )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> & vec3d<T>::operator|= ( vec3d<T> v )
+vec3d<T> & vec3d<T>::operator|= ( const vec3d<T> &v )
 {
   if (x[0]<v.x[0]) x[0]=v.x[0];
   if (x[1]<v.x[1]) x[1]=v.x[1];
@@ -263,7 +292,7 @@ vec3d<T> & vec3d<T>::operator|= ( vec3d<T> v )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> & vec3d<T>::operator&= ( vec3d<T> v )
+vec3d<T> & vec3d<T>::operator&= ( const vec3d<T> &v )
 {
   if (x[0]>v.x[0]) x[0]=v.x[0];
   if (x[1]>v.x[1]) x[1]=v.x[1];
@@ -285,7 +314,7 @@ vec3d<T> & vec3d<T>::operator*= ( T s )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> & vec3d<T>::operator^= ( vec3d<T> v )
+vec3d<T> & vec3d<T>::operator^= ( const vec3d<T> &v )
 {
   T a = x[1]*v.x[2]-x[2]*v.x[1];
   T b = x[2]*v.x[0]-x[0]*v.x[2];
@@ -299,45 +328,45 @@ vec3d<T> & vec3d<T>::operator^= ( vec3d<T> v )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> operator+ ( vec3d<T> p, vec3d<T> q )
+vec3d<T> operator+ ( const vec3d<T> &p, const vec3d<T> &q )
 {
-  p+=q;
-  return p;
+  vec3d<T> r(p);
+  r+=q;
+  return r;
 }
 
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> operator- ( vec3d<T> p, vec3d<T> q )
+vec3d<T> operator- ( const vec3d<T> &p, const vec3d<T> &q )
 {
-  p-=q;
-  return p;
+  vec3d<T> r(p);
+  r-=q;
+  return r;
 }
 
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> operator- ( vec3d<T> p )
+vec3d<T> operator- ( const vec3d<T> &p )
 {
-  p[0] = -p[0];
-  p[1] = -p[1];
-  p[2] = -p[2];
-  return p;
+  return vec3d<T>(-p[0],-p[1],-p[2]);
 }
 
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> operator^ ( vec3d<T> p, vec3d<T> q )
+vec3d<T> operator^ ( const vec3d<T> &p, const vec3d<T> &q )
 {
-  p^=q;
-  return p;
+  vec3d<T> r(p);
+  r^=q;
+  return r;
 }
 
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-bool operator== ( vec3d<T> p, vec3d<T> q )
+bool operator== ( const vec3d<T> &p, const vec3d<T> &q )
 {
   return p[0]==q[0] && p[1]==q[1] && p[2]==q[2];
 }
@@ -345,7 +374,7 @@ bool operator== ( vec3d<T> p, vec3d<T> q )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-bool operator> ( vec3d<T> p, vec3d<T> q )
+bool operator> ( const vec3d<T> &p, const vec3d<T> &q )
 {
   return p[0]>q[0] && p[1]>q[1] && p[2]>q[2];
 }
@@ -353,7 +382,7 @@ bool operator> ( vec3d<T> p, vec3d<T> q )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-bool operator< ( vec3d<T> p, vec3d<T> q )
+bool operator< ( const vec3d<T> &p, const vec3d<T> &q )
 {
   return p[0]<q[0] && p[1]<q[1] && p[2]<q[2];
 }
@@ -361,7 +390,7 @@ bool operator< ( vec3d<T> p, vec3d<T> q )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-bool operator>= ( vec3d<T> p, vec3d<T> q )
+bool operator>= ( const vec3d<T> &p, const vec3d<T> &q )
 {
   return p[0]>=q[0] && p[1]>=q[1] && p[2]>=q[2];
 }
@@ -369,7 +398,7 @@ bool operator>= ( vec3d<T> p, vec3d<T> q )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-bool operator<= ( vec3d<T> p, vec3d<T> q )
+bool operator<= ( const vec3d<T> &p, const vec3d<T> &q )
 {
   return p[0]<=q[0] && p[1]<=q[1] && p[2]<=q[2];
 }
@@ -377,7 +406,7 @@ bool operator<= ( vec3d<T> p, vec3d<T> q )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-bool operator!= ( vec3d<T> p, vec3d<T> q )
+bool operator!= ( const vec3d<T> &p, const vec3d<T> &q )
 {
   return p[0]!=q[0] || p[1]!=q[1] || p[2]!=q[2];
 }
@@ -385,16 +414,17 @@ bool operator!= ( vec3d<T> p, vec3d<T> q )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> operator* ( T p, vec3d<T> q )
+vec3d<T> operator* ( T p, const vec3d<T> &q )
 {
-  q*=p;
-  return q;
+  vec3d<T> r(q);
+  r*=p;
+  return r;
 }
 
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-T operator* ( vec3d<T> p, vec3d<T> q )
+T operator* ( const vec3d<T> &p, const vec3d<T> &q )
 {
   return p[0]*q[0]+p[1]*q[1]+p[2]*q[2];
 }
@@ -402,7 +432,7 @@ T operator* ( vec3d<T> p, vec3d<T> q )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> operator& ( vec3d<T> p, vec3d<T> q )
+vec3d<T> operator& ( const vec3d<T> &p, const vec3d<T> &q )
 {
   vec3d<T> res = p;
   res &=q;
@@ -412,7 +442,7 @@ vec3d<T> operator& ( vec3d<T> p, vec3d<T> q )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> operator| ( vec3d<T> p, vec3d<T> q )
+vec3d<T> operator| ( const vec3d<T> &p, const vec3d<T> &q )
 {
   vec3d<T> res = p;
   res |=q;
@@ -422,7 +452,7 @@ vec3d<T> operator| ( vec3d<T> p, vec3d<T> q )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-std::ostream & operator<< ( std::ostream &o, vec3d<T> v )
+std::ostream & operator<< ( std::ostream &o, const vec3d<T> &v )
 {
   o << "[ " << v[0] << " ; " << v[1] << " ; " << v[2] << " ]";
   return o;
@@ -437,6 +467,13 @@ T & vec3d<T>::operator[] ( int i )
   return x[i];
 }
 
+template<class T>
+const T & vec3d<T>::operator[] ( int i ) const
+{
+  assert(i>=0 && i<3);
+  return x[i];
+}
+
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
@@ -451,7 +488,7 @@ void vec3d<T>::normalize()
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-T vec3d<T>::norm()
+T vec3d<T>::norm() const
 {
   return sqrt(x[0]*x[0]+x[1]*x[1]+x[2]*x[2]);
 }
@@ -459,13 +496,88 @@ T vec3d<T>::norm()
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-T vec3d<T>::norm2()
+T vec3d<T>::norm2() const
 {
   return (x[0]*x[0]+x[1]*x[1]+x[2]*x[2]);
 }
 
 /* ---------------------------------------------------------------------------- */
 
+// AVX2 versions of the hot vec3dd operations; each lane is computed with
+// the same operations, in the same order, as the generic code above, so
+// results are bit-identical to the scalar build
+#ifdef __AVX2__
+
+template<>
+inline vec3d<double> & vec3d<double>::operator+= ( const vec3d<double> &v )
+{
+  _mm256_store_pd(x,_mm256_add_pd(_mm256_load_pd(x),_mm256_load_pd(v.x)));
+  return *this;
+}
+
+template<>
+inline vec3d<double> & vec3d<double>::operator-= ( const vec3d<double> &v )
+{
+  _mm256_store_pd(x,_mm256_sub_pd(_mm256_load_pd(x),_mm256_load_pd(v.x)));
+  return *this;
+}
+
+template<>
+inline vec3d<double> & vec3d<double>::operator*= ( double s )
+{
+  _mm256_store_pd(x,_mm256_mul_pd(_mm256_load_pd(x),_mm256_set_pd(0,s,s,s)));
+  return *this;
+}
+
+template<>
+inline vec3d<double> & vec3d<double>::operator^= ( const vec3d<double> &v )
+{
+  __m256d a = _mm256_load_pd(x);
+  __m256d b = _mm256_load_pd(v.x);
+  __m256d a1 = _mm256_permute4x64_pd(a,_MM_SHUFFLE(3,0,2,1));   // y z x
+  __m256d b1 = _mm256_permute4x64_pd(b,_MM_SHUFFLE(3,0,2,1));
+  __m256d a2 = _mm256_permute4x64_pd(a,_MM_SHUFFLE(3,1,0,2));   // z x y
+  __m256d b2 = _mm256_permute4x64_pd(b,_MM_SHUFFLE(3,1,0,2));
+  _mm256_store_pd(x,_mm256_sub_pd(_mm256_mul_pd(a1,b2),_mm256_mul_pd(a2,b1)));
+  return *this;
+}
+
+template<>
+inline double operator* ( const vec3d<double> &p, const vec3d<double> &q )
+{
+  __m256d m = _mm256_mul_pd(_mm256_load_pd(&p[0]),_mm256_load_pd(&q[0]));
+  __m128d lo = _mm256_castpd256_pd128(m);
+  __m128d s = _mm_add_sd(lo,_mm_unpackhi_pd(lo,lo));
+  return _mm_cvtsd_f64(_mm_add_sd(s,_mm256_extractf128_pd(m,1)));
+}
+
+#endif
+
+/* ---------------------------------------------------------------------------- */
+
+// f[i] -= (f[i]*n[i])*n[i] for i<cnt: removes the component of each
+// vector along the corresponding (unit) normal
+template<class T>
+void project_out ( int cnt, vec3d<T> *f, const vec3d<T> *n )
+{
+  for ( int i=0; i<cnt; i++ )
+    f[i] -= (f[i]*n[i])*n[i];
+}
+
+// the same for vectors stored as floats, computed in double
+inline void project_out ( int cnt, vec3df *f, const vec3df *n )
+{
+  for ( int i=0; i<cnt; i++ )
+    {
+      vec3dd fi = f[i];
+      vec3dd ni = n[i];
+      fi -= (fi*ni)*ni;
+      f[i] = fi;
+    }
+}
+
+/* ---------------------------------------------------------------------------- */
+
 template<class T>
 vec3d<T> randomv3()
 {
@@ -481,6 +593,23 @@ vec3d<T> randomv3()
   return res;
 }
 
+// same as above, but draws from the erand48 state xsubi rather than the 
+// global one: reproducible and safe to call from several threads
+template<class T>
+vec3d<T> randomv3 ( unsigned short xsubi[3] )
+{
+  vec3d<T> res;
+
+  do {
+    res = vec3d<T>(1-2*erand48(xsubi),1-2*erand48(xsubi),1-2*erand48(xsubi));
+  }
+  while (res*res<0.1);
+
+  res.normalize();
+
+  return res;
+}
+
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
@@ -492,7 +621,7 @@ void vec3d<T>::writeto ( std::ostream &o )
 /* ---------------------------------------------------------------------------- */
 
 template<class T>
-vec3d<T> average ( vec3d<T> u, vec3d<T> w )
+vec3d<T> average ( const vec3d<T> &u, const vec3d<T> &w )
 {
   return vec3d<T>((u[0]+w[0])/2,(u[1]+w[1])/2,(u[2]+w[2])/2);
 }
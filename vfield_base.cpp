@@ -35,9 +35,28 @@ vfield_base::vfield_base ( const char *name ) :
 {
 }
 
+vfield_base::vfield_base ( const vfield_base *m ) : 
+  mesh(m)
+{
+}
+
 vfield_base::~vfield_base()
 {
 }
 
+/* ------------------------------------------------------ */
+
+void vfield_base::connects_batch ( int cnt, const cquery *q, unsigned char *res )
+{
+  for ( int k=0; k<cnt; k++ )
+    res[k] = connects(q[k].fce,q[k].eix1,q[k].eix2,q[k].s1,q[k].e1,q[k].s2,q[k].e2);
+}
+
+/* ------------------------------------------------------ */
+
+void vfield_base::spread_changes ( bool *changed )
+{
+}
+
 /* ------------------------------------------------------ */
 /* ------------------------------------------------------ */
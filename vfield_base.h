@@ -34,6 +34,15 @@
 
 /* ------------------------------------------------------ */
 
+// arguments of one connects() call, for connects_batch
+class cquery {
+ public:
+  int fce, eix1, eix2;
+  double s1, e1, s2, e2;
+};
+
+/* ------------------------------------------------------ */
+
 class vfield_base : public mesh {
   
  public:
@@ -65,9 +74,19 @@ class vfield_base : public mesh {
   virtual bool connects ( int fce, int eix1, int eix2, 
 			  double s1 = 0, double e1 = 1, 
 			  double s2 = 0, double e2 = 1 ) = 0;
+
+  // res[k] = connects(q[k]) for k=0,...,cnt-1; the default makes cnt calls
+  virtual void connects_batch ( int cnt, const cquery *q, unsigned char *res );
+
+  // adds to the marked faces (one flag per face) the ones whose 
+  // attracts_flow, repels_flow and connects results may change when the 
+  // vectors of the marked ones do; by default, those depend on the face's
+  // own vector only
+  virtual void spread_changes ( bool *changed );
   
 
   vfield_base ( const char *name );
+  vfield_base ( const vfield_base *m );   // see mesh ( const mesh *m )
   virtual ~vfield_base();
 };
 